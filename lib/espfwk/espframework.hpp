@@ -59,6 +59,10 @@ void espReset();
 
 #include "esp32/rom/rtc.h"
 #define ESP_RESET forcedReset
+#elif defined(NATIVE)
+#include <FS.h>
+#include <LittleFS.h>
+#define ESP_RESET forcedReset
 #else  
 #error "You must define what platform is used, valid are: ESP8266, ESP32, ESP32S2, ESP32S3 or ESP32C3"
 #endif
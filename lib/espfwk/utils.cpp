@@ -26,7 +26,9 @@ SOFTWARE.
 #include <log.hpp>
 #include <utils.hpp>
 
-#if !defined(ESP8266)
+#if defined(NATIVE)
+// Host build, no watchdog or sdk headers
+#elif !defined(ESP8266)
 #include <esp_int_wdt.h>
 #include <esp_task_wdt.h>
 #else
@@ -64,12 +66,16 @@ char* convertFloatToString(float f, char* buffer, int dec) {
   return buffer;
 }
 
+#if defined(NATIVE)
+void tcp_cleanup() {}
+#else
 struct tcp_pcb;
 extern struct tcp_pcb* tcp_tw_pcbs;
 extern "C" void tcp_abort(struct tcp_pcb* pcb);
 void tcp_cleanup() {  // tcp cleanup, to avoid memory crash.
   while (tcp_tw_pcbs) tcp_abort(tcp_tw_pcbs);
 }
+#endif
 
 void deepSleep(int t) {
 #if LOG_LEVEL == 6
@@ -93,7 +99,9 @@ void printHeap(String prefix) {
 }
 
 void forcedReset() {
-#if !defined(ESP8266)
+#if defined(NATIVE)
+  exit(1);
+#elif !defined(ESP8266)
   ledOff();
   LittleFS.end();
   delay(100);
@@ -112,7 +120,7 @@ void espReset() {
 #endif
 }
 
-#if defined(ESP8266)
+#if defined(ESP8266) || defined(NATIVE)
 void detectChipRevision() {}
 bool isEsp32c3() { return false; }
 #else
@@ -168,6 +176,8 @@ void checkResetReason() {
              _rinfo->epc3, _rinfo->excvaddr, _rinfo->depc);
     writeErrorLog(&s[0]);
   }
+#elif defined(NATIVE)
+  Log.notice(F("UTIL: Last reset cause 'native host'" CR));
 #else  // defined (ESP32)
   RESET_REASON r = rtc_get_reset_reason(
       0);  // We only check cpu0 since we dont use cpu1 on the esp32
@@ -0,0 +1,183 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef LIB_NATIVE_ARDUINO_H_
+#define LIB_NATIVE_ARDUINO_H_
+
+// Minimal stand-in for the Arduino core so the gateway pipeline can be built
+// and profiled on a Linux host (env:native). Only what the project uses is
+// provided.
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define constrain(amt, low, high) \
+  ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+class __FlashStringHelper;
+
+class String {
+ private:
+  std::string _buffer;
+
+ public:
+  String() {}
+  String(const char* s) : _buffer(s ? s : "") {}  // NOLINT
+  String(const std::string& s) : _buffer(s) {}     // NOLINT
+  explicit String(char c) : _buffer(1, c) {}
+  explicit String(int value) : _buffer(std::to_string(value)) {}
+
+  const char* c_str() const { return _buffer.c_str(); }
+  unsigned int length() const { return _buffer.length(); }
+  char charAt(unsigned int index) const {
+    return index < _buffer.length() ? _buffer[index] : 0;
+  }
+  void reserve(unsigned int size) { _buffer.reserve(size); }
+  int compareTo(const String& s) const { return _buffer.compare(s._buffer); }
+
+  String& operator+=(const String& s) {
+    _buffer += s._buffer;
+    return *this;
+  }
+  String& operator+=(const char* s) {
+    _buffer += s;
+    return *this;
+  }
+  String& operator+=(char c) {
+    _buffer += c;
+    return *this;
+  }
+
+  bool operator==(const String& s) const { return _buffer == s._buffer; }
+  bool operator==(const char* s) const { return _buffer == s; }
+  bool operator!=(const String& s) const { return _buffer != s._buffer; }
+  bool operator!=(const char* s) const { return _buffer != s; }
+};
+
+class Print;
+
+class Printable {
+ public:
+  virtual ~Printable() {}
+  virtual size_t printTo(Print& p) const = 0;
+};
+
+class Print {
+ private:
+  size_t printNumber(uint64_t n, int base, bool negative);
+
+ public:
+  virtual ~Print() {}
+
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  size_t write(const char* s) {
+    return write(reinterpret_cast<const uint8_t*>(s), strlen(s));
+  }
+
+  size_t printf(const char* format, ...)
+      __attribute__((format(printf, 2, 3)));
+
+  size_t print(const __FlashStringHelper* s) {
+    return write(reinterpret_cast<const char*>(s));
+  }
+  size_t print(const String& s) { return write(s.c_str()); }
+  size_t print(const char* s) { return write(s); }
+  size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+  size_t print(int n, int base = DEC) {
+    return print(static_cast<long long>(n), base);  // NOLINT
+  }
+  size_t print(unsigned int n, int base = DEC) {
+    return print(static_cast<unsigned long long>(n), base);  // NOLINT
+  }
+  size_t print(long n, int base = DEC) {            // NOLINT
+    return print(static_cast<long long>(n), base);  // NOLINT
+  }
+  size_t print(unsigned long n, int base = DEC) {            // NOLINT
+    return print(static_cast<unsigned long long>(n), base);  // NOLINT
+  }
+  size_t print(long long n, int base = DEC);           // NOLINT
+  size_t print(unsigned long long n, int base = DEC);  // NOLINT
+  size_t print(double n, int digits = 2);
+  size_t print(const Printable& p) { return p.printTo(*this); }
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(const T& value) {
+    size_t n = print(value);
+    return n + println();
+  }
+};
+
+class HardwareSerial : public Print {
+ public:
+  void begin(uint32_t baud) {}
+  void flush() { fflush(stdout); }
+  int available() { return 0; }
+  int read() { return -1; }
+
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+class EspClass {
+ public:
+  uint64_t getEfuseMac() { return 0x0000a1b2c3d4e5f6ULL; }
+  uint32_t getFreeHeap() { return 0; }
+  uint32_t getFreeSketchSpace() { return 0; }
+  void deepSleep(uint64_t us) { exit(0); }
+};
+
+extern EspClass ESP;
+
+unsigned long millis();  // NOLINT
+unsigned long micros();  // NOLINT
+// Lets a replay drive millis()/micros() from recorded timestamps, a negative
+// value goes back to the host clock.
+void setNativeMillis(int64_t ms);
+void delay(uint32_t ms);
+void yield();
+
+bool getLocalTime(struct tm* info, uint32_t ms = 5000);
+
+char* dtostrf(double number, signed char width, unsigned char prec, char* s);
+
+#endif  // LIB_NATIVE_ARDUINO_H_
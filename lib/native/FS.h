@@ -0,0 +1,96 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef LIB_NATIVE_FS_H_
+#define LIB_NATIVE_FS_H_
+
+#include <Arduino.h>
+
+#include <memory>
+#include <string>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+// File handle backed by a stdio stream, copies share the same stream like
+// the Arduino implementation.
+class File : public Print {
+ private:
+  std::shared_ptr<FILE> _file;
+  std::string _path;
+
+ public:
+  File() {}
+  File(FILE* file, const char* path);
+
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+
+  int available();
+  int read();
+  size_t read(uint8_t* buffer, size_t size);
+  String readString();
+  bool seek(uint32_t pos, SeekMode mode = SeekSet);
+  size_t position() const;
+  size_t size() const;
+  void flush();
+  void close() { _file.reset(); }
+  const char* path() const { return _path.c_str(); }
+  FILE* handle() const { return _file.get(); }
+
+  explicit operator bool() const { return _file != nullptr; }
+};
+
+// File system rooted in a host directory, the root set by setRoot(),
+// NATIVE_FS_ROOT or the current working directory.
+class FS {
+ private:
+  std::string _root;
+
+ protected:
+  std::string fullPath(const char* path) const;
+
+ public:
+  void setRoot(const char* root) { _root = root; }
+
+  File open(const char* path, const char* mode = FILE_READ,
+            const bool create = false);
+  bool exists(const char* path);
+  bool remove(const char* path);
+  bool rename(const char* pathFrom, const char* pathTo);
+  bool mkdir(const char* path);
+};
+
+}  // namespace fs
+
+using fs::File;
+using fs::FS;
+using fs::SeekMode;
+
+#endif  // LIB_NATIVE_FS_H_
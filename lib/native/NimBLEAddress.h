@@ -0,0 +1,49 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef LIB_NATIVE_NIMBLEADDRESS_H_
+#define LIB_NATIVE_NIMBLEADDRESS_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+// Address stored in on-air (little endian) byte order as in NimBLE
+class NimBLEAddress {
+ private:
+  uint8_t _val[6] = {0};
+  uint8_t _type = 0;
+
+ public:
+  NimBLEAddress() {}
+  NimBLEAddress(const uint8_t* address, uint8_t type) : _type(type) {
+    memcpy(&_val[0], address, sizeof(_val));
+  }
+
+  const uint8_t* getVal() const { return &_val[0]; }
+  uint8_t getType() const { return _type; }
+  std::string toString() const;
+};
+
+#endif  // LIB_NATIVE_NIMBLEADDRESS_H_
@@ -0,0 +1,59 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef LIB_NATIVE_NIMBLEADVERTISEDDEVICE_H_
+#define LIB_NATIVE_NIMBLEADVERTISEDDEVICE_H_
+
+#include <NimBLEAddress.h>
+
+#include <string>
+#include <vector>
+
+class NimBLEAdvertisedDevice {
+ private:
+  NimBLEAddress _address;
+  int8_t _rssi = 0;
+  std::vector<uint8_t> _payload;
+
+ public:
+  NimBLEAdvertisedDevice() {}
+  NimBLEAdvertisedDevice(const NimBLEAddress& address, int8_t rssi,
+                         const uint8_t* payload, size_t length)
+      : _address(address), _rssi(rssi), _payload(payload, payload + length) {}
+
+  // Reuse the device object without reallocating the payload buffer
+  void set(const NimBLEAddress& address, int8_t rssi, const uint8_t* payload,
+           size_t length) {
+    _address = address;
+    _rssi = rssi;
+    _payload.assign(payload, payload + length);
+  }
+
+  NimBLEAddress getAddress() const { return _address; }
+  int getRSSI() const { return _rssi; }
+  const std::vector<uint8_t>& getPayload() const { return _payload; }
+  std::string getName() const;
+  std::string getManufacturerData(uint8_t index = 0) const;
+};
+
+#endif  // LIB_NATIVE_NIMBLEADVERTISEDDEVICE_H_
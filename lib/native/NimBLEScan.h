@@ -0,0 +1,96 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef LIB_NATIVE_NIMBLESCAN_H_
+#define LIB_NATIVE_NIMBLESCAN_H_
+
+#include <Arduino.h>
+#include <NimBLEAdvertisedDevice.h>
+
+#include <cstdint>
+
+class NimBLEScanResults {
+ public:
+  int getCount() const { return 0; }
+};
+
+class NimBLEScanCallbacks {
+ public:
+  virtual ~NimBLEScanCallbacks() {}
+  virtual void onDiscovered(const NimBLEAdvertisedDevice* advertisedDevice) {}
+  virtual void onResult(const NimBLEAdvertisedDevice* advertisedDevice) {}
+  virtual void onScanEnd(const NimBLEScanResults& scanResults, int reason) {}
+};
+
+// The host has no radio, adverts are injected by calling the callbacks
+// directly (see tools/).
+class NimBLEScan {
+ private:
+  NimBLEScanCallbacks* _callbacks = nullptr;
+  bool _scanning = false;
+  bool _activeScan = false;
+  uint16_t _interval = 100;
+  uint16_t _window = 100;
+  uint32_t _duration = 0;
+  uint32_t _startTime = 0;
+
+ public:
+  void setScanCallbacks(NimBLEScanCallbacks* callbacks,
+                        bool wantDuplicates = false) {
+    _callbacks = callbacks;
+  }
+  NimBLEScanCallbacks* getScanCallbacks() const { return _callbacks; }
+
+  void setMaxResults(uint8_t maxResults) {}
+  void setDuplicateFilter(uint8_t enabled) {}
+  void setActiveScan(bool active) { _activeScan = active; }
+  void setInterval(uint16_t intervalMs) { _interval = intervalMs; }
+  void setWindow(uint16_t windowMs) { _window = windowMs; }
+  uint16_t getInterval() const { return _interval; }
+  uint16_t getWindow() const { return _window; }
+
+  bool isScanning() const { return _scanning; }
+  bool start(uint32_t duration, bool isContinue = false,
+             bool restart = true) {
+    _scanning = true;
+    _duration = duration;
+    _startTime = millis();
+    return true;
+  }
+
+  // Ends the scan window once the duration has passed on the (replayed)
+  // clock, like the controller does on the device.
+  void poll() {
+    if (!_scanning || !_duration || millis() - _startTime < _duration) return;
+
+    _scanning = false;
+    if (_callbacks) _callbacks->onScanEnd(NimBLEScanResults(), 0);
+  }
+  bool stop() {
+    _scanning = false;
+    return true;
+  }
+  void clearResults() {}
+};
+
+#endif  // LIB_NATIVE_NIMBLESCAN_H_
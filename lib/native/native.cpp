@@ -0,0 +1,271 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <Arduino.h>
+#include <FS.h>
+#include <LittleFS.h>
+#include <NimBLEDevice.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+HardwareSerial Serial;
+EspClass ESP;
+fs::FS LittleFS;
+
+namespace {
+const std::chrono::steady_clock::time_point startTime =
+    std::chrono::steady_clock::now();
+int64_t fixedMillis = -1;
+}  // namespace
+
+void setNativeMillis(int64_t ms) { fixedMillis = ms; }
+
+unsigned long millis() {  // NOLINT
+  if (fixedMillis >= 0) return fixedMillis;
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now() - startTime)
+      .count();
+}
+
+unsigned long micros() {  // NOLINT
+  if (fixedMillis >= 0) return fixedMillis * 1000;
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - startTime)
+      .count();
+}
+
+void delay(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield() { std::this_thread::yield(); }
+
+bool getLocalTime(struct tm* info, uint32_t ms) {
+  time_t now = time(nullptr);
+  localtime_r(&now, info);
+  return true;
+}
+
+char* dtostrf(double number, signed char width, unsigned char prec, char* s) {
+  snprintf(s, 32, "%*.*f", width, prec, number);
+  return s;
+}
+
+// Print
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t n = 0;
+  while (size--) n += write(*buffer++);
+  return n;
+}
+
+size_t Print::printf(const char* format, ...) {
+  char buf[256];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  if (len < 0) return 0;
+  return write(reinterpret_cast<const uint8_t*>(buf),
+               len < static_cast<int>(sizeof(buf)) ? len : sizeof(buf) - 1);
+}
+
+size_t Print::printNumber(uint64_t n, int base, bool negative) {
+  char buf[66];
+  char* p = &buf[sizeof(buf) - 1];
+  *p = 0;
+
+  if (base < 2) base = 10;
+
+  do {
+    int digit = n % base;
+    *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    n /= base;
+  } while (n);
+
+  if (negative) *--p = '-';
+  return write(p);
+}
+
+size_t Print::print(long long n, int base) {  // NOLINT
+  if (base == DEC && n < 0) return printNumber(-n, base, true);
+  return printNumber(static_cast<uint64_t>(n), base, false);
+}
+
+size_t Print::print(unsigned long long n, int base) {  // NOLINT
+  return printNumber(n, base, false);
+}
+
+size_t Print::print(double n, int digits) {
+  char buf[40];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return write(buf);
+}
+
+size_t HardwareSerial::write(uint8_t c) { return fwrite(&c, 1, 1, stdout); }
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  return fwrite(buffer, 1, size, stdout);
+}
+
+// File system
+
+namespace fs {
+
+File::File(FILE* file, const char* path)
+    : _file(file, [](FILE* f) { fclose(f); }), _path(path) {}
+
+size_t File::write(uint8_t c) { return write(&c, 1); }
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+  if (!_file) return 0;
+  return fwrite(buffer, 1, size, _file.get());
+}
+
+int File::available() {
+  if (!_file) return 0;
+  return static_cast<int>(size() - position());
+}
+
+int File::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+  if (!_file) return 0;
+  return fread(buffer, 1, size, _file.get());
+}
+
+String File::readString() {
+  std::string s;
+  char buf[128];
+  size_t n;
+
+  while ((n = read(reinterpret_cast<uint8_t*>(buf), sizeof(buf))) > 0)
+    s.append(buf, n);
+  return String(s);
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+  if (!_file) return false;
+  int whence = mode == SeekSet ? SEEK_SET : mode == SeekCur ? SEEK_CUR
+                                                             : SEEK_END;
+  return fseek(_file.get(), pos, whence) == 0;
+}
+
+size_t File::position() const {
+  if (!_file) return 0;
+  return ftell(_file.get());
+}
+
+size_t File::size() const {
+  if (!_file) return 0;
+  struct stat st;
+  fflush(_file.get());
+  if (fstat(fileno(_file.get()), &st)) return 0;
+  return st.st_size;
+}
+
+void File::flush() {
+  if (_file) fflush(_file.get());
+}
+
+std::string FS::fullPath(const char* path) const {
+  if (!_root.empty()) return _root + path;
+
+  const char* root = getenv("NATIVE_FS_ROOT");
+  return std::string(root ? root : ".") + path;
+}
+
+File FS::open(const char* path, const char* mode, const bool create) {
+  std::string full = fullPath(path);
+  FILE* f = fopen(full.c_str(), mode);
+
+  if (!f) return File();
+  return File(f, path);
+}
+
+bool FS::exists(const char* path) {
+  struct stat st;
+  return stat(fullPath(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const char* path) {
+  return ::remove(fullPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char* pathFrom, const char* pathTo) {
+  return ::rename(fullPath(pathFrom).c_str(), fullPath(pathTo).c_str()) == 0;
+}
+
+bool FS::mkdir(const char* path) {
+  return ::mkdir(fullPath(path).c_str(), 0755) == 0;
+}
+
+}  // namespace fs
+
+// NimBLE
+
+std::string NimBLEAddress::toString() const {
+  char buf[18];
+  snprintf(buf, sizeof(buf), "%02x:%02x:%02x:%02x:%02x:%02x", _val[5], _val[4],
+           _val[3], _val[2], _val[1], _val[0]);
+  return std::string(buf);
+}
+
+namespace {
+std::string findAdStructure(const std::vector<uint8_t>& payload,
+                            uint8_t type) {
+  size_t i = 0;
+  while (i + 1 < payload.size() && payload[i]) {
+    size_t len = payload[i];
+    if (i + 1 + len > payload.size()) break;
+    if (payload[i + 1] == type)
+      return std::string(reinterpret_cast<const char*>(&payload[i + 2]),
+                         len - 1);
+    i += len + 1;
+  }
+  return std::string();
+}
+}  // namespace
+
+std::string NimBLEAdvertisedDevice::getName() const {
+  return findAdStructure(_payload, 0x09);
+}
+
+std::string NimBLEAdvertisedDevice::getManufacturerData(uint8_t index) const {
+  return findAdStructure(_payload, 0xff);
+}
+
+NimBLEScan* NimBLEDevice::getScan() {
+  static NimBLEScan scan;
+  return &scan;
+}
+
+// EOF
@@ -0,0 +1,191 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_BLE_ADVERTISEMENT_HPP_
+#define SRC_BLE_ADVERTISEMENT_HPP_
+
+#if defined(GATEWAY)
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+// AD types used by the gateway (Bluetooth Core Specification Supplement)
+constexpr uint8_t AD_TYPE_FLAGS = 0x01;
+constexpr uint8_t AD_TYPE_SHORT_NAME = 0x08;
+constexpr uint8_t AD_TYPE_COMPLETE_NAME = 0x09;
+constexpr uint8_t AD_TYPE_SERVICE_DATA16 = 0x16;
+constexpr uint8_t AD_TYPE_MANUFACTURER_DATA = 0xff;
+
+constexpr uint16_t EDDYSTONE_SERVICE_UUID = 0xfeaa;
+
+constexpr size_t BLE_ADDRESS_LENGTH = 6;
+
+// Non-owning view of a byte range inside an advertisement payload
+class ByteView {
+ private:
+  const uint8_t* _data = nullptr;
+  size_t _length = 0;
+
+ public:
+  ByteView() {}
+  ByteView(const uint8_t* data, size_t length)
+      : _data(data), _length(length) {}
+
+  const uint8_t* data() const { return _data; }
+  size_t length() const { return _length; }
+  bool empty() const { return _length == 0; }
+
+  uint8_t operator[](size_t index) const { return _data[index]; }
+
+  ByteView subview(size_t offset) const {
+    if (offset >= _length) return ByteView();
+    return ByteView(_data + offset, _length - offset);
+  }
+
+  bool equals(const char* text) const {
+    size_t len = strlen(text);
+    return len == _length && memcmp(_data, text, len) == 0;
+  }
+};
+
+// One length/type/value element of an advertisement
+struct AdStructure {
+  uint8_t type = 0;
+  ByteView value;
+};
+
+// Walks the AD structures in a payload, stops at the first malformed entry
+class AdIterator {
+ private:
+  const uint8_t* _pos = nullptr;
+  const uint8_t* _end = nullptr;
+  AdStructure _current;
+
+  void load() {
+    if (_pos >= _end || _pos[0] == 0 || _pos + 1 + _pos[0] > _end) {
+      _pos = _end;  // Zero length or truncated structure ends the payload
+      return;
+    }
+
+    _current.type = _pos[1];
+    _current.value = ByteView(_pos + 2, _pos[0] - 1);
+  }
+
+ public:
+  AdIterator(const uint8_t* pos, const uint8_t* end) : _pos(pos), _end(end) {
+    load();
+  }
+
+  const AdStructure& operator*() const { return _current; }
+  const AdStructure* operator->() const { return &_current; }
+
+  AdIterator& operator++() {
+    _pos += 1 + _pos[0];
+    load();
+    return *this;
+  }
+
+  bool operator!=(const AdIterator& other) const { return _pos != other._pos; }
+};
+
+// Read-only view of a received advertisement (advertising data + scan
+// response). Name, flags and manufacturer data are located in a single pass
+// so the decoders can inspect them without copying the payload.
+class AdvertisementView {
+ private:
+  const uint8_t* _payload = nullptr;
+  size_t _length = 0;
+  uint8_t _address[BLE_ADDRESS_LENGTH] = {0};
+  int8_t _rssi = 0;
+  uint8_t _flags = 0;
+  ByteView _name;
+  ByteView _manufacturerData;
+
+ public:
+  // Address is given in the on-air (little endian) byte order
+  AdvertisementView(const uint8_t* payload, size_t length,
+                    const uint8_t* address, int8_t rssi)
+      : _payload(payload), _length(length), _rssi(rssi) {
+    if (address) memcpy(&_address[0], address, BLE_ADDRESS_LENGTH);
+
+    for (const AdStructure& ad : *this) {
+      switch (ad.type) {
+        case AD_TYPE_FLAGS:
+          if (!ad.value.empty()) _flags = ad.value[0];
+          break;
+        case AD_TYPE_SHORT_NAME:
+          if (_name.empty()) _name = ad.value;
+          break;
+        case AD_TYPE_COMPLETE_NAME:
+          _name = ad.value;
+          break;
+        case AD_TYPE_MANUFACTURER_DATA:
+          if (_manufacturerData.empty()) _manufacturerData = ad.value;
+          break;
+      }
+    }
+  }
+
+  AdIterator begin() const { return AdIterator(_payload, _payload + _length); }
+  AdIterator end() const {
+    return AdIterator(_payload + _length, _payload + _length);
+  }
+
+  const uint8_t* getPayload() const { return _payload; }
+  size_t getPayloadLength() const { return _length; }
+
+  uint8_t getFlags() const { return _flags; }
+  const ByteView& getName() const { return _name; }
+  bool isName(const char* name) const { return _name.equals(name); }
+  const ByteView& getManufacturerData() const { return _manufacturerData; }
+
+  // Returns the data following the 16 bit service uuid, empty if not found
+  ByteView getServiceData(uint16_t uuid) const {
+    for (const AdStructure& ad : *this) {
+      if (ad.type == AD_TYPE_SERVICE_DATA16 && ad.value.length() >= 2 &&
+          (ad.value[0] | (ad.value[1] << 8)) == uuid)
+        return ad.value.subview(2);
+    }
+    return ByteView();
+  }
+
+  const uint8_t* getAddress() const { return &_address[0]; }
+  int8_t getRssi() const { return _rssi; }
+
+  // Last three bytes of the address as printed (aa:bb:cc:DD:EE:FF)
+  uint32_t getAddressSuffix() const {
+    return (_address[2] << 16) | (_address[1] << 8) | _address[0];
+  }
+
+  char* formatAddress(char* buf, size_t len) const {
+    snprintf(buf, len, "%02x:%02x:%02x:%02x:%02x:%02x", _address[5],
+             _address[4], _address[3], _address[2], _address[1], _address[0]);
+    return buf;
+  }
+};
+
+#endif  // GATEWAY
+
+#endif  // SRC_BLE_ADVERTISEMENT_HPP_
@@ -23,6 +23,8 @@ SOFTWARE.
  */
 #if defined(ENABLE_BLE) && defined(CHAMBER)
 
+#include <array>
+#include <ble_codec.hpp>
 #include <ble_chamber.hpp>
 #include <log.hpp>
 #include <string>
@@ -52,42 +54,24 @@ void BleSender::sendCustomBeaconData(float chamberTempC, float beerTempC) {
 
   _advertising->stop();
 
-  uint16_t c = chamberTempC * 1000;
-  uint16_t b = beerTempC * 1000;
-  uint32_t chipId = 0;
+  ChamberBeaconFrame frame;
 
   for (int i = 0; i < 17; i = i + 8) {
-    chipId |= ((ESP.getEfuseMac() >> (40 - i)) & 0xff) << i;
+    frame.chipId |= ((ESP.getEfuseMac() >> (40 - i)) & 0xff) << i;
   }
 
-  std::string mf = "";
-
-  mf += static_cast<char>(0x4C);  // Manuf ID (Apple)
-  mf += static_cast<char>(0x00);
-  mf += static_cast<char>(0x03);  // SubType (standards is 0x02)
-  mf += static_cast<char>(0x15);  // SubType Length
-  mf += "CHAMBER.";
-  mf += static_cast<char>(((chipId & 0xFF000000) >> 24));  // Chipid
-  mf += static_cast<char>(((chipId & 0xFF0000) >> 16));
-  mf += static_cast<char>(((chipId & 0xFF00) >> 8));
-  mf += static_cast<char>((chipId & 0xFF));
-  mf += static_cast<char>((c >> 8));  // Chamber Temp
-  mf += static_cast<char>((c & 0xFF));
-  mf += static_cast<char>((b >> 8));  // Beer Temp
-  mf += static_cast<char>((b & 0xFF));  
-  mf += static_cast<char>(0x00);
-  mf += static_cast<char>(0x00);
-  mf += static_cast<char>(0x00);
-  mf += static_cast<char>(0x00);
-  mf += static_cast<char>(0x00);  // Signal
+  frame.chamberTempC = chamberTempC;
+  frame.beerTempC = beerTempC;
+
+  std::array<uint8_t, ChamberBeaconFrame::LENGTH> mf = encodeFrame(frame);
 
 #if LOG_LEVEL == 6
-  dumpPayload(mf.c_str(), mf.length());
+  dumpPayload(reinterpret_cast<const char*>(mf.data()), mf.size());
 #endif
 
   BLEAdvertisementData advData = BLEAdvertisementData();
   advData.setFlags(0x04);
-  advData.setManufacturerData(mf);
+  advData.setManufacturerData(mf.data(), mf.size());
   _advertising->setAdvertisementData(advData);
 
   _advertising->setConnectableMode(BLE_GAP_CONN_MODE_NON);
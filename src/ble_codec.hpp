@@ -0,0 +1,404 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_BLE_CODEC_HPP_
+#define SRC_BLE_CODEC_HPP_
+
+// Wire formats for the beacons sent by BleSender and decoded by BleScanner.
+// Each frame layout is described once by its fields() method, the same
+// description is used by encodeFrame() and decodeFrame(). Only depends on
+// the standard library so it can also be used on the host.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Big endian helpers
+
+constexpr uint16_t load_be16(const uint8_t* p) {
+  return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+constexpr uint32_t load_be32(const uint8_t* p) {
+  return (static_cast<uint32_t>(p[0]) << 24) |
+         (static_cast<uint32_t>(p[1]) << 16) |
+         (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+inline void store_be16(uint8_t* p, uint16_t v) {
+  p[0] = static_cast<uint8_t>(v >> 8);
+  p[1] = static_cast<uint8_t>(v & 0xff);
+}
+
+inline void store_be32(uint8_t* p, uint32_t v) {
+  p[0] = static_cast<uint8_t>(v >> 24);
+  p[1] = static_cast<uint8_t>((v >> 16) & 0xff);
+  p[2] = static_cast<uint8_t>((v >> 8) & 0xff);
+  p[3] = static_cast<uint8_t>(v & 0xff);
+}
+
+// IEEE 754 single precision, big endian (RAPT)
+inline float load_be_float(const uint8_t* p) {
+  uint32_t bits = load_be32(p);
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+inline void store_be_float(uint8_t* p, float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  store_be32(p, bits);
+}
+
+// Field types, each knows where it lives in the frame and how the value is
+// scaled on the wire.
+
+template <size_t Offset, typename Wire>
+struct BeField;
+
+template <size_t Offset>
+struct BeField<Offset, uint8_t> {
+  static uint8_t decode(const uint8_t* frame) { return frame[Offset]; }
+  static void encode(uint8_t* frame, uint8_t v) { frame[Offset] = v; }
+};
+
+template <size_t Offset>
+struct BeField<Offset, uint16_t> {
+  static uint16_t decode(const uint8_t* frame) {
+    return load_be16(frame + Offset);
+  }
+  static void encode(uint8_t* frame, uint16_t v) {
+    store_be16(frame + Offset, v);
+  }
+};
+
+template <size_t Offset>
+struct BeField<Offset, int16_t> {
+  static int16_t decode(const uint8_t* frame) {
+    return static_cast<int16_t>(load_be16(frame + Offset));
+  }
+  static void encode(uint8_t* frame, int16_t v) {
+    store_be16(frame + Offset, static_cast<uint16_t>(v));
+  }
+};
+
+template <size_t Offset>
+struct BeField<Offset, uint32_t> {
+  static uint32_t decode(const uint8_t* frame) {
+    return load_be32(frame + Offset);
+  }
+  static void encode(uint8_t* frame, uint32_t v) {
+    store_be32(frame + Offset, v);
+  }
+};
+
+// Fixed point integer on the wire, value = wire / Scale
+template <size_t Offset, typename Wire, int Scale>
+struct ScaledField {
+  static float decode(const uint8_t* frame) {
+    return static_cast<float>(BeField<Offset, Wire>::decode(frame)) / Scale;
+  }
+  static void encode(uint8_t* frame, float v) {
+    BeField<Offset, Wire>::encode(frame, static_cast<Wire>(v * Scale));
+  }
+};
+
+// IEEE float on the wire, value = wire / Scale
+template <size_t Offset, int Scale>
+struct FloatField {
+  static float decode(const uint8_t* frame) {
+    return load_be_float(frame + Offset) / Scale;
+  }
+  static void encode(uint8_t* frame, float v) {
+    store_be_float(frame + Offset, v * Scale);
+  }
+};
+
+// Temperature in Kelvin * 128 (RAPT), value in C
+template <size_t Offset>
+struct KelvinField {
+  static float decode(const uint8_t* frame) {
+    return static_cast<float>(BeField<Offset, uint16_t>::decode(frame)) / 128 -
+           273.15;
+  }
+  static void encode(uint8_t* frame, float v) {
+    uint16_t t = (v + 273.15) * 128.0;
+    BeField<Offset, uint16_t>::encode(frame, t);
+  }
+};
+
+// Visitors applied to a frame description
+
+class FrameWriter {
+ private:
+  uint8_t* _frame;
+
+ public:
+  explicit FrameWriter(uint8_t* frame) : _frame(frame) {}
+
+  void constant(size_t offset, const uint8_t* data, size_t length) {
+    memcpy(_frame + offset, data, length);
+  }
+  template <typename Field, typename T>
+  void field(Field, const T& value) {
+    Field::encode(_frame, value);
+  }
+  void flag(size_t offset, bool value) { _frame[offset] = value ? 1 : 0; }
+};
+
+class FrameReader {
+ private:
+  const uint8_t* _frame;
+  bool _valid = true;
+
+ public:
+  explicit FrameReader(const uint8_t* frame) : _frame(frame) {}
+
+  bool isValid() const { return _valid; }
+
+  void constant(size_t offset, const uint8_t* data, size_t length) {
+    if (memcmp(_frame + offset, data, length)) _valid = false;
+  }
+  template <typename Field, typename T>
+  void field(Field, T& value) {  // NOLINT
+    value = Field::decode(_frame);
+  }
+  void flag(size_t offset, bool& value) {  // NOLINT
+    value = _frame[offset] > 0;
+  }
+};
+
+// Frame layouts. Every frame is the complete manufacturer data (including
+// the company id) or the complete service data after the uuid.
+
+// Custom iBeacon header, 0x4c00 (Apple) with subtype 0x03 (standard is 0x02)
+constexpr uint8_t GRAVMON_BEACON_HEADER[] = {0x4c, 0x00, 0x03, 0x15, 'G', 'R',
+                                             'A',  'V',  'M',  'O',  'N', '.'};
+constexpr uint8_t PRESMON_BEACON_HEADER[] = {0x4c, 0x00, 0x03, 0x15, 'P', 'R',
+                                             'E',  'S',  'M',  'O',  'N', '.'};
+constexpr uint8_t CHAMBER_BEACON_HEADER[] = {0x4c, 0x00, 0x03, 0x15, 'C', 'H',
+                                             'A',  'M',  'B',  'E',  'R', '.'};
+// Eddystone frame type 0x20 (unencrypted TLM), version 0x00
+constexpr uint8_t EDDYSTONE_TLM_HEADER[] = {0x20, 0x00};
+constexpr uint8_t RAPT_V1_HEADER[] = {'R', 'A', 'P', 'T', 0x01};
+constexpr uint8_t RAPT_V2_HEADER[] = {'R', 'A', 'P', 'T', 0x02};
+
+// 4c 00 03 15 GRAVMON. cccccccc aaaa bbbb gggg tttt ss
+struct GravmonBeaconFrame {
+  static constexpr size_t LENGTH = 25;
+
+  uint32_t chipId = 0;
+  float angle = 0;
+  float battery = 0;
+  float gravity = 0;
+  float tempC = 0;
+
+  template <typename Visitor>
+  void fields(Visitor& v) {  // NOLINT
+    v.constant(0, GRAVMON_BEACON_HEADER, sizeof(GRAVMON_BEACON_HEADER));
+    v.field(BeField<12, uint32_t>(), chipId);
+    v.field(ScaledField<16, uint16_t, 100>(), angle);
+    v.field(ScaledField<18, uint16_t, 1000>(), battery);
+    v.field(ScaledField<20, uint16_t, 10000>(), gravity);
+    v.field(ScaledField<22, uint16_t, 1000>(), tempC);
+  }
+};
+
+// 4c 00 03 15 PRESMON. cccccccc pppp PPPP bbbb tttt ss
+struct PresmonBeaconFrame {
+  static constexpr size_t LENGTH = 25;
+
+  uint32_t chipId = 0;
+  float pressure = 0;
+  float pressure1 = 0;
+  float battery = 0;
+  float tempC = 0;
+
+  template <typename Visitor>
+  void fields(Visitor& v) {  // NOLINT
+    v.constant(0, PRESMON_BEACON_HEADER, sizeof(PRESMON_BEACON_HEADER));
+    v.field(BeField<12, uint32_t>(), chipId);
+    v.field(ScaledField<16, uint16_t, 100>(), pressure);
+    v.field(ScaledField<18, uint16_t, 100>(), pressure1);
+    v.field(ScaledField<20, uint16_t, 1000>(), battery);
+    v.field(ScaledField<22, uint16_t, 1000>(), tempC);
+  }
+};
+
+// 4c 00 03 15 CHAMBER. cccccccc CCCC BBBB 00 00 00 00 ss
+struct ChamberBeaconFrame {
+  static constexpr size_t LENGTH = 25;
+
+  uint32_t chipId = 0;
+  float chamberTempC = 0;
+  float beerTempC = 0;
+
+  template <typename Visitor>
+  void fields(Visitor& v) {  // NOLINT
+    v.constant(0, CHAMBER_BEACON_HEADER, sizeof(CHAMBER_BEACON_HEADER));
+    v.field(BeField<12, uint32_t>(), chipId);
+    v.field(ScaledField<16, uint16_t, 1000>(), chamberTempC);
+    v.field(ScaledField<18, uint16_t, 1000>(), beerTempC);
+  }
+};
+
+// Service data for uuid 0xfeaa
+// 20 00 bbbb tttt gggg aaaa cccccccc
+struct GravmonEddystoneFrame {
+  static constexpr size_t LENGTH = 14;
+
+  uint32_t chipId = 0;
+  float angle = 0;
+  float battery = 0;
+  float gravity = 0;
+  float tempC = 0;
+
+  template <typename Visitor>
+  void fields(Visitor& v) {  // NOLINT
+    v.constant(0, EDDYSTONE_TLM_HEADER, sizeof(EDDYSTONE_TLM_HEADER));
+    v.field(ScaledField<2, uint16_t, 1000>(), battery);
+    v.field(ScaledField<4, uint16_t, 1000>(), tempC);
+    v.field(ScaledField<6, uint16_t, 10000>(), gravity);
+    v.field(ScaledField<8, uint16_t, 100>(), angle);
+    v.field(BeField<10, uint32_t>(), chipId);
+  }
+};
+
+// Service data for uuid 0xfeaa
+// 20 00 bbbb tttt pppp PPPP cccccccc
+struct PresmonEddystoneFrame {
+  static constexpr size_t LENGTH = 14;
+
+  uint32_t chipId = 0;
+  float pressure = 0;
+  float pressure1 = 0;
+  float battery = 0;
+  float tempC = 0;
+
+  template <typename Visitor>
+  void fields(Visitor& v) {  // NOLINT
+    v.constant(0, EDDYSTONE_TLM_HEADER, sizeof(EDDYSTONE_TLM_HEADER));
+    v.field(ScaledField<2, uint16_t, 1000>(), battery);
+    v.field(ScaledField<4, uint16_t, 1000>(), tempC);
+    v.field(ScaledField<6, uint16_t, 100>(), pressure);
+    v.field(ScaledField<8, uint16_t, 100>(), pressure1);
+    v.field(BeField<10, uint32_t>(), chipId);
+  }
+};
+
+/*
+  typedef struct __attribute__((packed)) {
+      char prefix[4];        // 0: RAPT
+      uint8_t version;       // 4: always 0x01
+      uint8_t mac[6];        // 5: MAC address
+      uint16_t temperature;  // 11: x / 128 - 273.15
+      float gravity;         // 13: / 1000
+      int16_t x;             // 17: x / 16
+      int16_t y;             // 19: x / 16
+      int16_t z;             // 21: x / 16
+      int16_t battery;       // 23: x / 256
+  } RAPTPillMetricsV1;
+*/
+struct RaptV1Frame {
+  static constexpr size_t LENGTH = 25;
+
+  float tempC = 0;
+  float gravity = 0;
+  float angleX = 0;
+  float angleY = 0;
+  float angleZ = 0;
+  float battery = 0;
+
+  template <typename Visitor>
+  void fields(Visitor& v) {  // NOLINT
+    v.constant(0, RAPT_V1_HEADER, sizeof(RAPT_V1_HEADER));
+    v.field(KelvinField<11>(), tempC);
+    v.field(FloatField<13, 1000>(), gravity);
+    v.field(ScaledField<17, int16_t, 16>(), angleX);
+    v.field(ScaledField<19, int16_t, 16>(), angleY);
+    v.field(ScaledField<21, int16_t, 16>(), angleZ);
+    v.field(ScaledField<23, int16_t, 256>(), battery);
+  }
+};
+
+/*
+  typedef struct __attribute__((packed)) {
+      char prefix[4];        // 0: RAPT
+      uint8_t version;       // 4: always 0x02
+      uint8_t padding;       // 5: not checked
+      bool gravity_velocity_valid; // 6:
+      float gravity_velocity; // 7:
+      uint16_t temperature;  // 11: x / 128 - 273.15
+      float gravity;         // 13: / 1000
+      int16_t x;             // 17: x / 16
+      int16_t y;             // 19: x / 16
+      int16_t z;             // 21: x / 16
+      int16_t battery;       // 23: x / 256
+  } RAPTPillMetricsV2;
+*/
+struct RaptV2Frame {
+  static constexpr size_t LENGTH = 25;
+
+  bool velocityValid = false;
+  float velocity = 0;
+  float tempC = 0;
+  float gravity = 0;
+  float angleX = 0;
+  float angleY = 0;
+  float angleZ = 0;
+  float battery = 0;
+
+  template <typename Visitor>
+  void fields(Visitor& v) {  // NOLINT
+    v.constant(0, RAPT_V2_HEADER, sizeof(RAPT_V2_HEADER));
+    v.flag(6, velocityValid);
+    v.field(FloatField<7, 1>(), velocity);
+    v.field(KelvinField<11>(), tempC);
+    v.field(FloatField<13, 1000>(), gravity);
+    v.field(ScaledField<17, int16_t, 16>(), angleX);
+    v.field(ScaledField<19, int16_t, 16>(), angleY);
+    v.field(ScaledField<21, int16_t, 16>(), angleZ);
+    v.field(ScaledField<23, int16_t, 256>(), battery);
+  }
+};
+
+template <typename Frame>
+std::array<uint8_t, Frame::LENGTH> encodeFrame(Frame frame) {
+  std::array<uint8_t, Frame::LENGTH> data;
+  data.fill(0);
+  FrameWriter writer(data.data());
+  frame.fields(writer);
+  return data;
+}
+
+template <typename Frame>
+bool decodeFrame(const uint8_t* data, size_t length, Frame* frame) {
+  if (length < Frame::LENGTH) return false;
+  FrameReader reader(data);
+  frame->fields(reader);
+  return reader.isValid();
+}
+
+#endif  // SRC_BLE_CODEC_HPP_
@@ -0,0 +1,176 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_BLE_DEDUP_HPP_
+#define SRC_BLE_DEDUP_HPP_
+
+#if defined(GATEWAY)
+
+#include <ble_advertisement.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Default time an unchanged payload is suppressed, after that it is passed
+// on again so the measurement is refreshed.
+constexpr uint32_t BLE_DEDUP_TTL = 10000;
+
+// Fixed size table of the last payload hash seen per device address. Every
+// beacon is received on up to three channels per advertising event and the
+// senders repeat the same payload for several seconds, only adverts with a
+// new payload (or an expired one) need to be decoded.
+//
+// Open addressing with a short probe sequence, when all probed slots are in
+// use the least recently seen device is replaced. Updated from the scan
+// callback only, the counters can be read from any task.
+template <size_t Size>
+class AdvertDedup {
+  static_assert(Size >= 8 && (Size & (Size - 1)) == 0,
+                "Size must be a power of two");
+
+ private:
+  static constexpr size_t MAX_PROBE = 8;
+
+  struct Entry {
+    uint8_t address[BLE_ADDRESS_LENGTH];
+    bool used;
+    int8_t rssi;
+    uint32_t hash;
+    uint32_t firstSeen;  // When this payload was first received
+    uint32_t lastSeen;
+  };
+
+  Entry _entries[Size] = {};
+  uint32_t _ttl = BLE_DEDUP_TTL;
+  uint32_t _accepted = 0;
+  uint32_t _duplicates = 0;
+  uint32_t _replaced = 0;
+  uint32_t _newDevices = 0;
+  Entry* _pending = nullptr;  // Payload let through, kept by accept()
+  uint32_t _pendingHash = 0;
+  uint32_t _pendingTime = 0;
+
+  void setPending(Entry* e, uint32_t hash, uint32_t now) {
+    _pending = e;
+    _pendingHash = hash;
+    _pendingTime = now;
+    _accepted++;
+  }
+
+  static uint32_t fnv1a(const uint8_t* data, size_t length,
+                        uint32_t h = 2166136261u) {
+    for (size_t i = 0; i < length; i++) h = (h ^ data[i]) * 16777619u;
+    return h;
+  }
+
+ public:
+  void setTtl(uint32_t ttl) { _ttl = ttl; }
+  uint32_t getTtl() const { return _ttl; }
+
+  // Returns true if the same device sent the same payload within the TTL,
+  // in that case only last seen and RSSI are refreshed. A new payload is only
+  // remembered when accept() is called, so an advert that could not be queued
+  // is not suppressed when it is repeated.
+  bool isDuplicate(const uint8_t* address, const uint8_t* payload,
+                   size_t length, int8_t rssi, uint32_t now) {
+    uint32_t hash = fnv1a(payload, length);
+    size_t slot = fnv1a(address, BLE_ADDRESS_LENGTH) & (Size - 1);
+    Entry* victim = nullptr;
+    _pending = nullptr;
+
+    for (size_t i = 0; i < MAX_PROBE; i++) {
+      Entry& e = _entries[(slot + i) & (Size - 1)];
+
+      if (!e.used) {
+        if (!victim || victim->used) victim = &e;
+        continue;
+      }
+
+      if (memcmp(e.address, address, BLE_ADDRESS_LENGTH) == 0) {
+        e.lastSeen = now;
+        e.rssi = rssi;
+
+        if (_ttl && e.hash == hash && now - e.firstSeen < _ttl) {
+          _duplicates++;
+          return true;
+        }
+
+        setPending(&e, hash, now);
+        return false;
+      }
+
+      if (!victim || (victim->used && now - e.lastSeen > now - victim->lastSeen))
+        victim = &e;
+    }
+
+    if (victim->used) _replaced++;
+    _newDevices++;
+
+    memcpy(victim->address, address, BLE_ADDRESS_LENGTH);
+    victim->used = true;
+    victim->rssi = rssi;
+    victim->hash = hash;
+    victim->firstSeen = now - _ttl;  // No payload accepted yet
+    victim->lastSeen = now;
+    setPending(victim, hash, now);
+    return false;
+  }
+
+  // Remembers the payload last let through by isDuplicate()
+  void accept() {
+    if (!_pending) return;
+
+    _pending->hash = _pendingHash;
+    _pending->firstSeen = _pendingTime;
+    _pending = nullptr;
+  }
+
+  void clear() { memset(_entries, 0, sizeof(_entries)); }
+
+  // Devices seen within staleAfter (active) and devices last seen between
+  // staleAfter and forgetAfter (stale), older ones are no longer counted.
+  void countDevices(uint32_t now, uint32_t staleAfter, uint32_t forgetAfter,
+                    uint32_t* active, uint32_t* stale) const {
+    *active = *stale = 0;
+
+    for (const Entry& e : _entries) {
+      if (!e.used) continue;
+
+      uint32_t age = now - e.lastSeen;
+      if (age < staleAfter)
+        (*active)++;
+      else if (age < forgetAfter)
+        (*stale)++;
+    }
+  }
+
+  size_t capacity() const { return Size; }
+  uint32_t getAccepted() const { return _accepted; }
+  uint32_t getDuplicates() const { return _duplicates; }
+  uint32_t getReplaced() const { return _replaced; }
+  uint32_t getNewDevices() const { return _newDevices; }
+};
+
+#endif  // GATEWAY
+
+#endif  // SRC_BLE_DEDUP_HPP_
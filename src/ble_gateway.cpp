@@ -23,8 +23,10 @@ SOFTWARE.
  */
 #if defined(GATEWAY)
 
+#include <ble_codec.hpp>
 #include <ble_gateway.hpp>
 #include <cstdio>
+#include <cstring>
 #include <log.hpp>
 #include <memory>
 #include <string>
@@ -33,313 +35,317 @@ SOFTWARE.
 
 BleScanner bleScanner;
 
-constexpr auto TILT_COLOR_RED_UUID = "a495bb10c5b14b44b5121370f02d74de";
-constexpr auto TILT_COLOR_GREEN_UUID = "a495bb20c5b14b44b5121370f02d74de";
-constexpr auto TILT_COLOR_BLACK_UUID = "a495bb30c5b14b44b5121370f02d74de";
-constexpr auto TILT_COLOR_PURPLE_UUID = "a495bb40c5b14b44b5121370f02d74de";
-constexpr auto TILT_COLOR_ORANGE_UUID = "a495bb50c5b14b44b5121370f02d74de";
-constexpr auto TILT_COLOR_BLUE_UUID = "a495bb60c5b14b44b5121370f02d74de";
-constexpr auto TILT_COLOR_YELLOW_UUID = "a495bb70c5b14b44b5121370f02d74de";
-constexpr auto TILT_COLOR_PINK_UUID = "a495bb80c5b14b44b5121370f02d74de";
+// Tilt uuid a495bbX0-c5b1-4b44-b512-1370f02d74de, X is the color 1..8
+constexpr uint8_t TILT_UUID[16] = {0xa4, 0x95, 0xbb, 0x00, 0xc5, 0xb1,
+                                   0x4b, 0x44, 0xb5, 0x12, 0x13, 0x70,
+                                   0xf0, 0x2d, 0x74, 0xde};
+constexpr size_t TILT_UUID_COLOR_INDEX = 3;
+// iBeacon: prefix, uuid, major (temp), minor (gravity) and tx power
+constexpr size_t TILT_BEACON_LENGTH = 25;
 
 constexpr auto SERV_UUID = "180A";
 constexpr auto SERV2_UUID = "1801";
 constexpr auto CHAR_UUID = "2AC4";
 
+constexpr uint32_t beaconPrefix(uint8_t b0, uint8_t b1, uint8_t b2,
+                                uint8_t b3) {
+  return (static_cast<uint32_t>(b0) << 24) | (static_cast<uint32_t>(b1) << 16) |
+         (static_cast<uint32_t>(b2) << 8) | b3;
+}
+
+constexpr uint64_t beaconTag(const char *tag, int i = 0) {
+  return i == 8 ? 0
+                : (static_cast<uint64_t>(static_cast<uint8_t>(tag[i]))
+                   << (56 - 8 * i)) |
+                      beaconTag(tag, i + 1);
+}
+
+// Known beacon families, adding a new format only requires a new entry here.
+// The minimum lengths are those of the codec frames, so that a payload that
+// can not be decoded does not use a dedup slot or a queue entry.
+constexpr BeaconType BEACON_TYPES[] = {
+    {beaconPrefix(0x4c, 0x00, 0x03, 0x15), beaconTag("GRAVMON."),
+     GravmonBeaconFrame::LENGTH, "GRAVMON",
+     &BleScanner::proccesGravitymonBeacon},
+    {beaconPrefix(0x4c, 0x00, 0x03, 0x15), beaconTag("PRESMON."),
+     PresmonBeaconFrame::LENGTH, "PRESMON",
+     &BleScanner::proccesPressuremonBeacon},
+    {beaconPrefix(0x4c, 0x00, 0x03, 0x15), beaconTag("CHAMBER."),
+     ChamberBeaconFrame::LENGTH, "CHAMBER", &BleScanner::proccesChamberBeacon},
+    {beaconPrefix('R', 'A', 'P', 'T'), 0, RaptV1Frame::LENGTH, "RAPT v1/v2",
+     &BleScanner::proccesRaptBeacon},
+    {beaconPrefix(0x4c, 0x00, 0x02, 0x15), 0, TILT_BEACON_LENGTH, "TILT",
+     &BleScanner::proccesTiltBeacon},
+};
+
+static_assert(RaptV1Frame::LENGTH == RaptV2Frame::LENGTH,
+              "RAPT v1 and v2 share a registry entry");
+
+constexpr EddystoneType EDDYSTONE_TYPES[] = {
+    {"gravitymon", "gravitymon", &BleScanner::processGravitymonEddystoneBeacon},
+    {"pressuremon", "pressuremon",
+     &BleScanner::processPressuremonEddystoneBeacon},
+};
+
+const BeaconType *findBeaconType(const AdvertisementView &advert) {
+  const ByteView &mfg = advert.getManufacturerData();
+
+  if (mfg.length() < 8) return nullptr;
+
+  uint32_t prefix = beaconPrefix(mfg[0], mfg[1], mfg[2], mfg[3]);
+  uint64_t tag = 0;
+
+  if (mfg.length() >= 12) {
+    for (int i = 4; i < 12; i++) tag = (tag << 8) | mfg[i];
+  }
+
+  for (const BeaconType &type : BEACON_TYPES) {
+    if (type.prefix == prefix && (type.tag == 0 || type.tag == tag) &&
+        mfg.length() >= type.minLength)
+      return &type;
+  }
+
+  return nullptr;
+}
+
+const EddystoneType *findEddystoneType(const AdvertisementView &advert) {
+  if (advert.getName().empty()) return nullptr;
+
+  for (const EddystoneType &type : EDDYSTONE_TYPES) {
+    if (advert.isName(type.deviceName)) return &type;
+  }
+
+  return nullptr;
+}
+
 void BleDeviceCallbacks::onResult(
-  const NimBLEAdvertisedDevice *advertisedDevice) {
-  // Log.notice(F("BLE : %s,%s %d" CR),
-  //            advertisedDevice->getAddress().toString().c_str(),
-  //            advertisedDevice->getName().c_str(),
-  //             advertisedDevice->getManufacturerData().length());
-
-  if (advertisedDevice->getName() == "gravitymon") {
-    bool eddyStone = false;
-
-    // Print out the advertised services
-    for (int i = 0; i < advertisedDevice->getServiceDataCount(); i++) {
-      // Check if we have a gravitymon eddy stone beacon.
-      for (int i = 0; i < advertisedDevice->getServiceDataCount(); i++) {
-        if (advertisedDevice->getServiceDataUUID(i).toString() ==
-            "0xfeaa") {  // id for eddystone beacon
-          eddyStone = true;
-        }
-      }
-    }
-
-    if (eddyStone) {
-      Log.notice(F("BLE : Processing gravitymon eddy stone device" CR));
-      bleScanner.processGravitymonEddystoneBeacon(
-          advertisedDevice->getAddress(), advertisedDevice->getPayload());
-    }
+    const NimBLEAdvertisedDevice *advertisedDevice) {
+  // Runs on the NimBLE host task, decoding and storage is done by the
+  // consumer so a slow SD card or serial port can't stall the BLE stack.
+  bleScanner.queueAdvert(advertisedDevice);
+}
 
-    return;
-  } else if (advertisedDevice->getName() == "pressuremon") {
-    bool eddyStone = false;
-
-    // Print out the advertised services
-    for (int i = 0; i < advertisedDevice->getServiceDataCount(); i++)
-      // Check if we have a pressuremon eddy stone beacon.
-      for (int i = 0; i < advertisedDevice->getServiceDataCount(); i++) {
-        if (advertisedDevice->getServiceDataUUID(i).toString() ==
-            "0xfeaa") {  // id for eddystone beacon
-          eddyStone = true;
-        }
-      }
-
-    if (eddyStone) {
-      Log.notice(F("BLE : Processing pressuremon eddy stone device" CR));
-      bleScanner.processPressuremonEddystoneBeacon(
-          advertisedDevice->getAddress(), advertisedDevice->getPayload());
-    }
+void BleDeviceCallbacks::onScanEnd(const NimBLEScanResults &scanResults,
+                                   int reason) {
+  bleScanner.scanEnded(reason);
+}
 
+void BleScanner::queueAdvert(const NimBLEAdvertisedDevice *advertisedDevice) {
+  const std::vector<uint8_t> &payload = advertisedDevice->getPayload();
+  NimBLEAddress address = advertisedDevice->getAddress();
+  int8_t rssi = advertisedDevice->getRSSI();
+  uint32_t now = millis();
+
+  // Adverts of other devices (phones, headphones, TVs) are dropped before the
+  // dedup table, so that only the known beacons drive the adaptive scan
+  AdvertisementView advert(payload.data(), payload.size(), nullptr, rssi);
+  if (!findEddystoneType(advert) && !findBeaconType(advert)) {
+    _foreignAdverts++;
     return;
   }
 
-  // Check if we have a gravmon/pressmon/chamber iBeacon to process
-
-  if (advertisedDevice->getManufacturerData().length() >= 24) {
-    if (advertisedDevice->getManufacturerData()[0] == 0x4c &&
-        advertisedDevice->getManufacturerData()[1] == 0x00 &&
-        advertisedDevice->getManufacturerData()[2] == 0x03 &&
-        advertisedDevice->getManufacturerData()[3] == 0x15) {
-      Log.notice(
-          F("BLE : Advertised iBeacon GRAVMON/PRESMON/CHAMBER device: %s" CR),
-          advertisedDevice->getAddress().toString().c_str());
-
-      bleScanner.proccesGravitymonBeacon(
-          advertisedDevice->getManufacturerData(),
-          advertisedDevice->getAddress());
-      bleScanner.proccesPressuremonBeacon(
-          advertisedDevice->getManufacturerData(),
-          advertisedDevice->getAddress());
-      bleScanner.proccesChamberBeacon(advertisedDevice->getManufacturerData(),
-                                      advertisedDevice->getAddress());
-    }
-  }
+  // Repeated payloads only refresh last seen/RSSI and are never decoded
+  if (_dedup.isDuplicate(address.getVal(), payload.data(), payload.size(), rssi,
+                         now))
+    return;
+
+  RawAdvert *raw = _queue.reserve();
+
+  if (!raw) return;  // Full, counted as dropped
+
+  raw->timestamp = now;
+  memcpy(&raw->address[0], address.getVal(), BLE_ADDRESS_LENGTH);
+  raw->rssi = rssi;
+  raw->length = payload.size() < BLE_MAX_PAYLOAD ? payload.size()
+                                                  : BLE_MAX_PAYLOAD;
+  memcpy(&raw->payload[0], payload.data(), raw->length);
+  _queue.commit();
+  _dedup.accept();
+
+#if !defined(NATIVE)
+  if (_consumerTask) xTaskNotifyGive(_consumerTask);
+#endif
+}
+
+void BleScanner::processQueue() {
+  const RawAdvert *raw;
+  bool updated = false;
 
-  // Check if we have a rapt v1/v2 iBeacon to process
-
-  if (advertisedDevice->getManufacturerData().length() >= 24) {
-    if (advertisedDevice->getManufacturerData()[0] == 0x52 &&
-        advertisedDevice->getManufacturerData()[1] == 0x41 &&
-        advertisedDevice->getManufacturerData()[2] == 0x50 &&
-        advertisedDevice->getManufacturerData()[3] == 0x54) {
-      Log.notice(
-          F("BLE : Advertised iBeacon RAPT v1/v2 device: %s" CR),
-          advertisedDevice->getAddress().toString().c_str());
-
-      bleScanner.proccesRaptBeacon(
-          advertisedDevice->getManufacturerData(),
-          advertisedDevice->getAddress());
-    }
+  while ((raw = _queue.front()) != nullptr) {
+    AdvertisementView advert(&raw->payload[0], raw->length, &raw->address[0],
+                             raw->rssi);
+    if (processAdvert(advert)) updated = true;
+    _queue.pop();
   }
 
-  // Check if we have a tilt iBeacon to process
+  if (updated) notifyUpdate();
+}
+
+void BleScanner::notifyUpdate() {
+#if !defined(NATIVE)
+  if (_updateEvent) xSemaphoreGive(_updateEvent);
+#else
+  _updateEvent = true;
+#endif
+}
+
+bool BleScanner::waitForUpdate(uint32_t timeout) {
+#if !defined(NATIVE)
+  if (!_updateEvent) return false;
+  return xSemaphoreTake(_updateEvent, pdMS_TO_TICKS(timeout)) == pdTRUE;
+#else
+  bool updated = _updateEvent;  // The replay drives the consumer itself
+  _updateEvent = false;
+  return updated;
+#endif
+}
 
-  if (advertisedDevice->getManufacturerData().length() >= 24) {
-    if (advertisedDevice->getManufacturerData()[0] == 0x4c &&
-        advertisedDevice->getManufacturerData()[1] == 0x00 &&
-        advertisedDevice->getManufacturerData()[2] == 0x02 &&
-        advertisedDevice->getManufacturerData()[3] == 0x15) {
-      Log.notice(F("BLE : Advertised iBeacon TILT device: %s" CR),
-                 advertisedDevice->getAddress().toString().c_str());
+#if !defined(NATIVE)
+void BleScanner::consumerTask(void *parameter) {
+  BleScanner *scanner = static_cast<BleScanner *>(parameter);
 
-      bleScanner.proccesTiltBeacon(advertisedDevice->getManufacturerData(),
-                                   advertisedDevice->getRSSI());
-    }
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    scanner->processQueue();
   }
 }
+#endif
+
+bool BleScanner::processAdvert(const AdvertisementView &advert) {
+  char address[18];
+
+  // Log.notice(F("BLE : %s %d" CR),
+  //            advert.formatAddress(address, sizeof(address)),
+  //            advert.getManufacturerData().length());
+
+  const EddystoneType *eddystone = findEddystoneType(advert);
+
+  // The decoders return false for a frame the codec rejects, so that the
+  // consumer is not woken up for it
+  if (eddystone) {
+    Log.notice(F("BLE : Processing %s eddy stone device" CR), eddystone->name);
+    return (this->*(eddystone->decoder))(advert);
+  }
 
-void BleScanner::proccesGravitymonBeacon(const std::string &advertStringHex,
-                                         NimBLEAddress address) {
-  const char *payload = advertStringHex.c_str();
-
-  float battery;
-  float temp;
-  float gravity;
-  float angle;
-  uint32_t chipId;
-
-  if (*(payload + 4) == 'G' && *(payload + 5) == 'R' && *(payload + 6) == 'A' &&
-      *(payload + 7) == 'V') {
-    Log.info(F("BLE : Found gravitymon beacon." CR));
-
-    chipId = (*(payload + 12) << 24) | (*(payload + 13) << 16) |
-             (*(payload + 14) << 8) | *(payload + 15);
-    angle = static_cast<float>((*(payload + 16) << 8) | *(payload + 17)) / 100;
-    battery =
-        static_cast<float>((*(payload + 18) << 8) | *(payload + 19)) / 1000;
-    gravity =
-        static_cast<float>((*(payload + 20) << 8) | *(payload + 21)) / 10000;
-    temp = static_cast<float>((*(payload + 22) << 8) | *(payload + 23)) / 1000;
-
-    char chip[20];
-    snprintf(chip, sizeof(chip), "%06x", chipId);
-
-    std::unique_ptr<MeasurementBaseData> gravityData;
-    gravityData.reset(new GravityData(MeasurementSource::BleBeacon, chip, "",
-                                      "", temp, gravity, angle, battery, 0, 0,
-                                      0));
-
-    Log.info(F("BLE : Update data for gravitymon %s." CR),
-             gravityData->getId());
-    myMeasurementList.updateData(gravityData);
+  const BeaconType *beacon = findBeaconType(advert);
+
+  if (beacon) {
+    Log.notice(F("BLE : Advertised iBeacon %s device: %s" CR), beacon->name,
+               advert.formatAddress(address, sizeof(address)));
+    return (this->*(beacon->decoder))(advert);
   }
+
+  return false;
 }
 
-void BleScanner::processGravitymonEddystoneBeacon(
-    NimBLEAddress address, const std::vector<uint8_t> &payload) {
-  //                                                                      <--------------
-  //                                                                      beacon
-  //                                                                      data
-  //                                                                      ------------>
-  // 0b 09 67 72 61 76 69 74 79 6d 6f 6e 02 01 06 03 03 aa fe 11 16 aa fe 20 00
-  // 0c 8b 10 8b 00 00 30 39 00 00 16 2e
-
-  float battery;
-  float temp;
-  float gravity;
-  float angle;
-  uint32_t chipId;
-
-  battery = static_cast<float>((payload[25] << 8) | payload[26]) / 1000;
-  temp = static_cast<float>((payload[27] << 8) | payload[28]) / 1000;
-  gravity = static_cast<float>((payload[29] << 8) | payload[30]) / 10000;
-  angle = static_cast<float>((payload[31] << 8) | payload[32]) / 100;
-  chipId = (payload[33] << 24) | (payload[34] << 16) | (payload[35] << 8) |
-           (payload[36]);
-
-  char chip[20];
-  snprintf(chip, sizeof(chip), "%06x", chipId);
-
-  std::unique_ptr<MeasurementBaseData> gravityData;
-  gravityData.reset(new GravityData(MeasurementSource::BleEddyStone, chip, "",
-                                    "", temp, gravity, angle, battery, 0, 0,
-                                    0));
-
-  Log.info(F("BLE : Update data for gravitymon %s." CR), gravityData->getId());
+bool BleScanner::proccesGravitymonBeacon(const AdvertisementView &advert) {
+  const ByteView &payload = advert.getManufacturerData();
+  GravmonBeaconFrame frame;
+
+  if (!decodeFrame(payload.data(), payload.length(), &frame)) return false;
+
+  GravityData gravityData(MeasurementSource::BleBeacon, frame.chipId, "", "",
+                          frame.tempC, frame.gravity, frame.angle,
+                          frame.battery, 0, 0, 0);
+
+  Log.info(F("BLE : Update data for gravitymon %s." CR), gravityData.getId());
   myMeasurementList.updateData(gravityData);
+  return true;
 }
 
-void BleScanner::proccesPressuremonBeacon(const std::string &advertStringHex,
-                                          NimBLEAddress address) {
-  const char *payload = advertStringHex.c_str();
-
-  if (*(payload + 4) == 'P' && *(payload + 5) == 'R' && *(payload + 6) == 'E' &&
-      *(payload + 7) == 'S') {
-    Log.info(F("BLE : Found pressuremon beacon." CR));
-
-    float battery;
-    float temp;
-    float pressure;
-    float pressure1;
-    uint32_t chipId;
-
-    chipId = (*(payload + 12) << 24) | (*(payload + 13) << 16) |
-             (*(payload + 14) << 8) | *(payload + 15);
-    pressure =
-        static_cast<float>((*(payload + 16) << 8) | *(payload + 17)) / 100;
-    pressure1 =
-        static_cast<float>((*(payload + 18) << 8) | *(payload + 19)) / 100;
-    battery =
-        static_cast<float>((*(payload + 20) << 8) | *(payload + 21)) / 1000;
-    temp = static_cast<float>((*(payload + 22) << 8) | *(payload + 23)) / 1000;
-
-    char chip[20];
-    snprintf(chip, sizeof(chip), "%06x", chipId);
-
-    std::unique_ptr<MeasurementBaseData> pressureData;
-    pressureData.reset(new PressureData(MeasurementSource::BleBeacon, chip, "",
-                                        "", temp, pressure, pressure1, battery,
-                                        0, 0, 0));
-
-    Log.info(F("BLE : Update data for pressuremon %s." CR),
-             pressureData->getId());
-    myMeasurementList.updateData(pressureData);
-  }
+bool BleScanner::processGravitymonEddystoneBeacon(
+    const AdvertisementView &advert) {
+  ByteView payload = advert.getServiceData(EDDYSTONE_SERVICE_UUID);
+  GravmonEddystoneFrame frame;
+
+  if (!decodeFrame(payload.data(), payload.length(), &frame)) return false;
+
+  GravityData gravityData(MeasurementSource::BleEddyStone, frame.chipId, "",
+                          "", frame.tempC, frame.gravity, frame.angle,
+                          frame.battery, 0, 0, 0);
+
+  Log.info(F("BLE : Update data for gravitymon %s." CR), gravityData.getId());
+  myMeasurementList.updateData(gravityData);
+  return true;
 }
 
-void BleScanner::processPressuremonEddystoneBeacon(
-    NimBLEAddress address, const std::vector<uint8_t> &payload) {
-  //                                                                      <--------------
-  //                                                                      beacon
-  //                                                                      data
-  //                                                                      ------------>
-  // 0b 09 67 72 61 76 69 74 79 6d 6f 6e 02 01 06 03 03 aa fe 11 16 aa fe 20 00
-  // 0c 8b 10 8b 00 00 30 39 00 00 16 2e
-
-  float battery;
-  float temp;
-  float pressure;
-  float pressure1;
-  uint32_t chipId;
-
-  battery = static_cast<float>((payload[25] << 8) | payload[26]) / 1000;
-  temp = static_cast<float>((payload[27] << 8) | payload[28]) / 1000;
-  pressure = static_cast<float>((payload[29] << 8) | payload[30]) / 100;
-  pressure1 = static_cast<float>((payload[31] << 8) | payload[32]) / 100;
-  chipId = (payload[33] << 24) | (payload[34] << 16) | (payload[35] << 8) |
-           (payload[36]);
-
-  char chip[20];
-  snprintf(chip, sizeof(chip), "%06x", chipId);
-
-  std::unique_ptr<MeasurementBaseData> pressureData;
-  pressureData.reset(new PressureData(MeasurementSource::BleEddyStone, chip, "",
-                                      "", temp, pressure, pressure1, battery, 0,
-                                      0, 0));
+bool BleScanner::proccesPressuremonBeacon(const AdvertisementView &advert) {
+  const ByteView &payload = advert.getManufacturerData();
+  PresmonBeaconFrame frame;
+
+  if (!decodeFrame(payload.data(), payload.length(), &frame)) return false;
+
+  PressureData pressureData(MeasurementSource::BleBeacon, frame.chipId, "",
+                            "", frame.tempC, frame.pressure, frame.pressure1,
+                            frame.battery, 0, 0, 0);
 
   Log.info(F("BLE : Update data for pressuremon %s." CR),
-           pressureData->getId());
+           pressureData.getId());
   myMeasurementList.updateData(pressureData);
+  return true;
 }
 
-void BleScanner::proccesChamberBeacon(const std::string &advertStringHex,
-                                      NimBLEAddress address) {
-  const char *payload = advertStringHex.c_str();
+bool BleScanner::processPressuremonEddystoneBeacon(
+    const AdvertisementView &advert) {
+  ByteView payload = advert.getServiceData(EDDYSTONE_SERVICE_UUID);
+  PresmonEddystoneFrame frame;
 
-  if (*(payload + 4) == 'C' && *(payload + 5) == 'H' && *(payload + 6) == 'A' &&
-      *(payload + 7) == 'M') {
-    Log.info(F("BLE : Found chamber beacon." CR));
+  if (!decodeFrame(payload.data(), payload.length(), &frame)) return false;
 
-    float chamberTempC;
-    float beerTempC;
-    uint32_t chipId;
+  PressureData pressureData(MeasurementSource::BleEddyStone, frame.chipId,
+                            "", "", frame.tempC, frame.pressure,
+                            frame.pressure1, frame.battery, 0, 0, 0);
+
+  Log.info(F("BLE : Update data for pressuremon %s." CR),
+           pressureData.getId());
+  myMeasurementList.updateData(pressureData);
+  return true;
+}
 
-    chipId = (*(payload + 12) << 24) | (*(payload + 13) << 16) |
-             (*(payload + 14) << 8) | *(payload + 15);
-    chamberTempC =
-        static_cast<float>((*(payload + 16) << 8) | *(payload + 17)) / 1000;
-    beerTempC =
-        static_cast<float>((*(payload + 18) << 8) | *(payload + 19)) / 1000;
+bool BleScanner::proccesChamberBeacon(const AdvertisementView &advert) {
+  const ByteView &payload = advert.getManufacturerData();
+  ChamberBeaconFrame frame;
 
-    char chip[20];
-    snprintf(chip, sizeof(chip), "%06x", chipId);
+  if (!decodeFrame(payload.data(), payload.length(), &frame)) return false;
 
-    std::unique_ptr<MeasurementBaseData> chamberData;
-    chamberData.reset(new ChamberData(MeasurementSource::BleBeacon, chip,
-                                      chamberTempC, beerTempC, 0));
+  ChamberData chamberData(MeasurementSource::BleBeacon, frame.chipId,
+                          frame.chamberTempC, frame.beerTempC, 0);
 
-    Log.info(F("BLE : Update data for chamber %s." CR), chamberData->getId());
-    myMeasurementList.updateData(chamberData);
-  }
+  Log.info(F("BLE : Update data for chamber %s." CR), chamberData.getId());
+  myMeasurementList.updateData(chamberData);
+  return true;
 }
 
 BleScanner::BleScanner() { _deviceCallbacks = new BleDeviceCallbacks(); }
 
 void BleScanner::init() {
+#if !defined(NATIVE)
+  if (!_updateEvent) _updateEvent = xSemaphoreCreateBinary();
+
+  if (!_consumerTask) {
+    // Same core as the arduino loop, the NimBLE host runs on core 0
+    xTaskCreatePinnedToCore(consumerTask, "bleConsumer", 8192, this, 1,
+                            &_consumerTask, 1);
+  }
+#endif
+
   NimBLEDevice::init("");
   _bleScan = NimBLEDevice::getScan();
   _bleScan->setScanCallbacks(_deviceCallbacks);
   _bleScan->setMaxResults(0);
   _bleScan->setActiveScan(_activeScan);
 
-  _bleScan->setInterval(
-      97);  // Select prime numbers to reduce risk of frequency beat pattern
-            // with ibeacon advertisement interval
-  _bleScan->setWindow(37);  // Set to less or equal setInterval value. Leave
-                            // reasonable gap to allow WiFi some time.
+  if (_adaptiveScan) {
+    const ScanMetrics &metrics = _scanController.getMetrics();
+    _bleScan->setInterval(metrics.interval);
+    _bleScan->setWindow(metrics.window);
+  } else {
+    _bleScan->setInterval(
+        97);  // Select prime numbers to reduce risk of frequency beat pattern
+              // with ibeacon advertisement interval
+    _bleScan->setWindow(37);  // Set to less or equal setInterval value. Leave
+                              // reasonable gap to allow WiFi some time.
+  }
   scan();
 }
 
@@ -350,29 +356,58 @@ bool BleScanner::scan() {
 
   if (_bleScan->isScanning()) return true;
 
-  _bleScan->clearResults();
-
-  Log.notice(F("BLE : Starting %s scan." CR),
+  Log.notice(F("BLE : Starting %s %s scan." CR),
+             _continuous ? "continuous" : "single",
              _activeScan ? "ACTIVE" : "PASSIVE");
+  return startScan();
+}
+
+void BleScanner::updateScanParameters() {
+  const ScanControllerConfig &config = _scanController.getConfig();
+  uint32_t now = millis();
+  uint32_t active, stale;
+
+  _dedup.countDevices(now, config.staleAfter, config.forgetAfter, &active,
+                      &stale);
+
+  if (_scanController.update(
+          now, _dedup.getAccepted() + _dedup.getDuplicates(),
+          _dedup.getDuplicates(), _dedup.getNewDevices(), active, stale)) {
+    const ScanMetrics &metrics = _scanController.getMetrics();
+    _bleScan->setInterval(metrics.interval);
+    _bleScan->setWindow(metrics.window);
+  }
+}
+
+bool BleScanner::startScan() {
+  _bleScan->clearResults();
   _bleScan->setActiveScan(_activeScan);
-  _bleScan->start(_scanTime * 1000, false, true);
 
-  // NimBLEScanResults foundDevices =
-  //     _bleScan->getResults(_scanTime * 1000, false);
-  // _bleScan->clearResults();  // delete results scan buffer to release memory
+  if (_scanEnded) {
+    uint32_t idle = micros() - _scanEndTime;
 
-  Log.notice(F("BLE : Scanning completed." CR));
-  return true;
+    _scanIdleTime += idle;
+    if (idle > _scanMaxIdleTime) _scanMaxIdleTime = idle;
+    _scanEnded = false;
+  }
+
+  return _bleScan->start(_scanTime * 1000, false, true);
 }
 
-void BleScanner::proccesTiltBeacon(const std::string &advertStringHex,
-                                   const int8_t &currentRSSI) {
-  TiltColor color;
+void BleScanner::scanEnded(int reason) {
+  // Called on the NimBLE host task when a scan window is completed
+  _scanEndTime = micros();
+  _scanEnded = true;
+  _scanWindows++;
 
-  // Check that this is an iBeacon packet
-  if (advertStringHex[0] != 0x4c || advertStringHex[1] != 0x00 ||
-      advertStringHex[2] != 0x02 || advertStringHex[3] != 0x15)
-    return;
+  if (_adaptiveScan) updateScanParameters();
+
+  if (_continuous) startScan();
+}
+
+bool BleScanner::proccesTiltBeacon(const AdvertisementView &advert) {
+  const ByteView &payload = advert.getManufacturerData();
+  TiltColor color;
 
   // The advertisement string is the "manufacturer data" part of the
   // following: Advertised Device: Name: Tilt, Address: 88:c2:55:ac:26:81,
@@ -380,41 +415,16 @@ void BleScanner::proccesTiltBeacon(const std::string &advertStringHex,
   // 4c000215a495bb40c5b14b44b5121370f02d74de005004d9c5
   // ????????iiiiiiiiiiiiiiiiiiiiiiiiiiiiiiiittttggggXR
   // **********----------**********----------**********
-  char hexCode[3] = {'\0'};
-  char colorArray[33] = {'\0'};
-  char tempArray[5] = {'\0'};
-  char gravityArray[5] = {'\0'};
-  char txPowerArray[3] = {'\0'};
-
-  for (int i = 4; i < advertStringHex.length(); i++) {
-    snprintf(hexCode, sizeof(hexCode), "%.2x", advertStringHex[i]);
-    // Indices 4 - 19 each generate two characters of the color array
-    if ((i > 3) && (i < 20)) {
-      strncat(colorArray, hexCode, 2);
-    }
-    // Indices 20-21 each generate two characters of thfe temperature array
-    if (i == 20 || i == 21) {
-      strncat(tempArray, hexCode, 2);
-    }
-    // Indices 22-23 each generate two characters of the sp_gravity array
-    if (i == 22 || i == 23) {
-      strncat(gravityArray, hexCode, 2);
-    }
-    // Index 24 contains the tx_pwr (which is used by recent tilts to indicate
-    // battery age)
-    if (i == 24) {
-      strncat(txPowerArray, hexCode, 2);
-    }
-  }
-
-  color = uuidToTiltColor(colorArray);
+  color = uuidToTiltColor(payload.data() + 4);
   if (color == TiltColor::None) {
-    return;
+    return false;
   }
 
-  uint16_t temp = std::strtoul(tempArray, nullptr, 16);
-  uint16_t gravity = std::strtoul(gravityArray, nullptr, 16);
-  uint8_t txPower = std::strtoul(txPowerArray, nullptr, 16);
+  // Major/minor are big endian, index 24 contains the tx_pwr (which is used
+  // by recent tilts to indicate battery age)
+  uint16_t temp = (payload[20] << 8) | payload[21];
+  uint16_t gravity = (payload[22] << 8) | payload[23];
+  uint8_t txPower = payload[24];
 
   float gravityFactor = 1000;
   float tempFactor = 1;
@@ -426,139 +436,56 @@ void BleScanner::proccesTiltBeacon(const std::string &advertStringHex,
     pro = true;
   }
 
-  std::unique_ptr<MeasurementBaseData> tiltData;
-  tiltData.reset(new TiltData(MeasurementSource::BleBeacon, color,
-                              temp / tempFactor, gravity / gravityFactor,
-                              txPower, 0, pro));
+  TiltData tiltData(MeasurementSource::BleBeacon, color, temp / tempFactor,
+                    gravity / gravityFactor, txPower, 0, pro);
 
-  Log.info(F("BLE : Update data for tilt %s." CR), tiltData->getId());
+  Log.info(F("BLE : Update data for tilt %s." CR), tiltData.getId());
   myMeasurementList.updateData(tiltData);
+  return true;
 }
 
-TiltColor BleScanner::uuidToTiltColor(std::string uuid) {
-  if (uuid == TILT_COLOR_RED_UUID) {
-    return TiltColor::Red;
-  } else if (uuid == TILT_COLOR_GREEN_UUID) {
-    return TiltColor::Green;
-  } else if (uuid == TILT_COLOR_BLACK_UUID) {
-    return TiltColor::Black;
-  } else if (uuid == TILT_COLOR_PURPLE_UUID) {
-    return TiltColor::Purple;
-  } else if (uuid == TILT_COLOR_ORANGE_UUID) {
-    return TiltColor::Orange;
-  } else if (uuid == TILT_COLOR_BLUE_UUID) {
-    return TiltColor::Blue;
-  } else if (uuid == TILT_COLOR_YELLOW_UUID) {
-    return TiltColor::Yellow;
-  } else if (uuid == TILT_COLOR_PINK_UUID) {
-    return TiltColor::Pink;
-  }
-  return TiltColor::None;
+TiltColor BleScanner::uuidToTiltColor(const uint8_t *uuid) {
+  // Only the high nibble of byte 3 differs between the colors (0x10..0x80)
+  if (memcmp(uuid, &TILT_UUID[0], TILT_UUID_COLOR_INDEX) ||
+      memcmp(uuid + TILT_UUID_COLOR_INDEX + 1,
+             &TILT_UUID[TILT_UUID_COLOR_INDEX + 1],
+             sizeof(TILT_UUID) - TILT_UUID_COLOR_INDEX - 1))
+    return TiltColor::None;
+
+  uint8_t color = uuid[TILT_UUID_COLOR_INDEX];
+
+  if ((color & 0x0f) || color < 0x10 || color > 0x80) return TiltColor::None;
+
+  return static_cast<TiltColor>((color >> 4) - 1);
 }
 
-void BleScanner::proccesRaptBeacon(const std::string &advertStringHex,
-                                         NimBLEAddress address) {
-  const char *payload = advertStringHex.c_str();
-
-  float battery;
-  float temp;
-  float gravity;
-  float velocity = 0;
-  float angleX, angleY, angleZ;
-  uint32_t chipId;
-  // 01234567890123456 // Use the last part of the mac adress as chipId
-  // 5d:d2:61:6a:01:ba
-  String chip = std::string(address.toString().substr(9, 2) + address.toString().substr(12, 2) + address.toString().substr(15, 2)).c_str();
-
-  union { // For mapping the raw float to bytes
-      float f;
-      uint8_t b[4];
-  } floatUnion;
-
-  if(*(payload+4) == 0x01) {
-    Log.info(F("BLE : Found rapt v1 beacon." CR));
+bool BleScanner::proccesRaptBeacon(const AdvertisementView &advert) {
+  const ByteView &payload = advert.getManufacturerData();
+  RaptV1Frame v1;
+  RaptV2Frame v2;
 
-    /*
-      typedef struct __attribute__((packed)) {
-          char prefix[4];        // 0: RAPT
-          uint8_t version;       // 4: always 0x01
-          uint8_t mac[6];        // 5: MAC address
-          uint16_t temperature;  // 11: x / 128 - 273.15
-          float gravity;         // 13: / 1000
-          int16_t x;             // 15: x / 16
-          int16_t y;             // 17:  x / 16
-          int16_t z;             // 19: x / 16
-          int16_t battery;       // 21: x / 256
-      } RAPTPillMetricsV1;
-    */
-
-    temp = static_cast<float>((*(payload + 11) << 8) | *(payload + 12)) / 128 - 273.15;
-
-    floatUnion.b[0] = *(payload + 16);
-    floatUnion.b[1] = *(payload + 15);
-    floatUnion.b[2] = *(payload + 14);
-    floatUnion.b[3] = *(payload + 13);
-    gravity = floatUnion.f;
-
-    angleX = static_cast<float>((*(payload + 17) << 8) | *(payload + 18)) / 16;
-    angleY = static_cast<float>((*(payload + 19) << 8) | *(payload + 20)) / 16;
-    angleZ = static_cast<float>((*(payload + 21) << 8) | *(payload + 22)) / 16;
-
-    battery = static_cast<float>((*(payload + 23) << 8) | *(payload + 24)) / 256;
-
-    std::unique_ptr<MeasurementBaseData> raptData;
-    raptData.reset(new RaptData(MeasurementSource::BleBeacon, chip, temp, gravity, 0, angleX, battery, 0, 0));
-
-    Log.info(F("BLE : Update data for rapt %s." CR),
-             raptData->getId());
-    myMeasurementList.updateData(raptData);
-  } else if(*(payload+4) == 0x02) {
-    Log.info(F("BLE : Found rapt v2 beacon." CR));
+  // Use the last part of the mac adress as chipId, 5d:d2:61:6a:01:ba
+  uint32_t chip = advert.getAddressSuffix();
+
+  Measurement raptData;
 
-    /*
-      typedef struct __attribute__((packed)) {
-          char prefix[4];        // 0: RAPT
-          uint8_t version;       // 4: always 0x02
-          bool gravity_velocity_valid; // 5:
-          float gravity_velocity; // 6:
-          uint16_t temperature;  // 10: x / 128 - 273.15
-          float gravity;         // 12: / 1000
-          int16_t x;             // 16: x / 16
-          int16_t y;             // 18: x / 16
-          int16_t z;             // 20: x / 16
-          int16_t battery;       // 22: x / 256
-      } RAPTPillMetricsV2;
-    */
-
-    if(*(payload+6) > 0) {
-      floatUnion.b[0] = *(payload + 10);
-      floatUnion.b[1] = *(payload + 9);
-      floatUnion.b[2] = *(payload + 8);
-      floatUnion.b[3] = *(payload + 7);
-      velocity = floatUnion.f;
-    }
-
-    temp = static_cast<float>((*(payload + 11) << 8) | *(payload + 12)) / 128 - 273.15;
-
-    floatUnion.b[0] = *(payload + 16);
-    floatUnion.b[1] = *(payload + 15);
-    floatUnion.b[2] = *(payload + 14);
-    floatUnion.b[3] = *(payload + 13);
-    gravity = floatUnion.f / 1000;
-
-    angleX = static_cast<float>((*(payload + 17) << 8) | *(payload + 18)) / 16;
-    angleY = static_cast<float>((*(payload + 19) << 8) | *(payload + 20)) / 16;
-    angleZ = static_cast<float>((*(payload + 21) << 8) | *(payload + 22)) / 16;
-
-    battery = static_cast<float>((*(payload + 23) << 8) | *(payload + 24)) / 256;
-
-    std::unique_ptr<MeasurementBaseData> raptData;
-    raptData.reset(new RaptData(MeasurementSource::BleBeacon, chip, temp, gravity, velocity, angleX, battery, 0, 0));
-
-    Log.info(F("BLE : Update data for rapt %s." CR),
-             raptData->getId());
-    myMeasurementList.updateData(raptData);
+  if (decodeFrame(payload.data(), payload.length(), &v1)) {
+    Log.info(F("BLE : Found rapt v1 beacon." CR));
+    raptData = RaptData(MeasurementSource::BleBeacon, chip, v1.tempC,
+                        v1.gravity, 0, v1.angleX, v1.battery, 0, 0);
+  } else if (decodeFrame(payload.data(), payload.length(), &v2)) {
+    Log.info(F("BLE : Found rapt v2 beacon." CR));
+    raptData = RaptData(MeasurementSource::BleBeacon, chip, v2.tempC,
+                        v2.gravity, v2.velocityValid ? v2.velocity : 0,
+                        v2.angleX, v2.battery, 0, 0);
+  } else {
+    return false;
   }
+
+  Log.info(F("BLE : Update data for rapt %s." CR),
+           raptData.getData()->getId());
+  myMeasurementList.updateData(raptData);
+  return true;
 }
 
 #endif  // GATEWAY
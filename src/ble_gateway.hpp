@@ -31,13 +31,20 @@ SOFTWARE.
 #include <NimBLEScan.h>
 #include <NimBLEUtils.h>
 
+#include <ble_advertisement.hpp>
+#include <ble_dedup.hpp>
+#include <ble_queue.hpp>
+#include <ble_scan_controller.hpp>
 #include <measurement.hpp>
-#include <queue>
-#include <string>
-#include <vector>
+
+// Adverts waiting between the scan callback and the consumer task
+constexpr size_t BLE_QUEUE_SIZE = 64;
+// Devices tracked by the duplicate filter
+constexpr size_t BLE_DEDUP_SIZE = 64;
 
 class BleDeviceCallbacks : public NimBLEScanCallbacks {
   void onResult(const NimBLEAdvertisedDevice *advertisedDevice) override;
+  void onScanEnd(const NimBLEScanResults &scanResults, int reason) override;
 };
 
 class BleScanner {
@@ -49,36 +56,110 @@ class BleScanner {
   bool scan();
   void setScanTime(int scanTime) { _scanTime = scanTime; }
   void setAllowActiveScan(bool activeScan) { _activeScan = activeScan; }
+  // Restart the scan directly from the scan end callback, no dead time
+  // between the scan windows
+  void setContinuous(bool continuous) { _continuous = continuous; }
+  // Adjust scan interval/window after every window from the advert load
+  void setAdaptiveScan(bool adaptive) { _adaptiveScan = adaptive; }
+  ScanController &getScanController() { return _scanController; }
+  void scanEnded(int reason);
+
+  // Blocks until new data has been added to the measurement list or the
+  // timeout (ms) expires, returns true if there was an update
+  bool waitForUpdate(uint32_t timeout);
+
+  uint32_t getScanWindows() const { return _scanWindows; }
+  // Time (us) between the end of a scan window and the start of the next
+  uint32_t getScanIdleTime() const { return _scanIdleTime; }
+  uint32_t getScanMaxIdleTime() const { return _scanMaxIdleTime; }
+
+  // Called from the scan callback, copies the advert and returns immediately
+  void queueAdvert(const NimBLEAdvertisedDevice *advertisedDevice);
+  // Decodes all queued adverts, runs in the consumer task (or the caller on
+  // the native build)
+  void processQueue();
+  bool processAdvert(const AdvertisementView &advert);
+
+  // Time an unchanged payload from the same device is ignored, 0 disables
+  void setDedupTtl(uint32_t ttl) { _dedup.setTtl(ttl); }
+  uint32_t getDedupAccepted() const { return _dedup.getAccepted(); }
+  uint32_t getDedupDuplicates() const { return _dedup.getDuplicates(); }
+  // Adverts not from a known beacon format, ignored by the scan callback
+  uint32_t getForeignAdverts() const { return _foreignAdverts; }
+
+  uint32_t getQueuePushed() const { return _queue.getPushed(); }
+  uint32_t getQueueDropped() const { return _queue.getDropped(); }
+  uint32_t getQueueHighWater() const { return _queue.getHighWater(); }
 
-  void proccesTiltBeacon(const std::string &advertStringHex,
-                         const int8_t &currentRSSI);
+  bool proccesTiltBeacon(const AdvertisementView &advert);
 
-  void proccesGravitymonBeacon(const std::string &advertStringHex,
-                               NimBLEAddress address);
-  void processGravitymonEddystoneBeacon(NimBLEAddress address,
-                                        const std::vector<uint8_t> &payload);
+  bool proccesGravitymonBeacon(const AdvertisementView &advert);
+  bool processGravitymonEddystoneBeacon(const AdvertisementView &advert);
 
-  void proccesRaptBeacon(const std::string &advertStringHex,
-                               NimBLEAddress address);
+  bool proccesRaptBeacon(const AdvertisementView &advert);
 
-  void proccesPressuremonBeacon(const std::string &advertStringHex,
-                                NimBLEAddress address);
-  void processPressuremonEddystoneBeacon(NimBLEAddress address,
-                                         const std::vector<uint8_t> &payload);
+  bool proccesPressuremonBeacon(const AdvertisementView &advert);
+  bool processPressuremonEddystoneBeacon(const AdvertisementView &advert);
 
-  void proccesChamberBeacon(const std::string &advertStringHex,
-                            NimBLEAddress address);
+  bool proccesChamberBeacon(const AdvertisementView &advert);
 
  private:
   int _scanTime = 5;
   bool _activeScan = false;
+  bool _continuous = false;
+  bool _adaptiveScan = false;
+
+  bool _scanEnded = false;
+  uint32_t _scanEndTime = 0;
+  uint32_t _scanWindows = 0;
+  uint32_t _scanIdleTime = 0;
+  uint32_t _scanMaxIdleTime = 0;
+  uint32_t _foreignAdverts = 0;
 
   BLEScan *_bleScan = nullptr;
 
   BleDeviceCallbacks *_deviceCallbacks = nullptr;
-  TiltColor uuidToTiltColor(std::string uuid);
+  SpscRing<RawAdvert, BLE_QUEUE_SIZE> _queue;
+  AdvertDedup<BLE_DEDUP_SIZE> _dedup;
+  ScanController _scanController;
+
+#if !defined(NATIVE)
+  TaskHandle_t _consumerTask = nullptr;
+  SemaphoreHandle_t _updateEvent = nullptr;
+  static void consumerTask(void *parameter);
+#else
+  bool _updateEvent = false;
+#endif
+
+  bool startScan();
+  void updateScanParameters();
+  void notifyUpdate();
+
+  TiltColor uuidToTiltColor(const uint8_t *uuid);
+};
+
+// Decoder registry entry for beacons identified by their manufacturer data.
+// The first four bytes (company id + subtype/length, or a text prefix) are
+// compared as one 32 bit value, the custom 0x0315 frames also carry an 8 byte
+// tag at offset 4. A tag of 0 matches any payload.
+struct BeaconType {
+  uint32_t prefix;
+  uint64_t tag;
+  uint8_t minLength;
+  const char *name;
+  bool (BleScanner::*decoder)(const AdvertisementView &advert);
 };
 
+// Decoder registry entry for Eddystone TLM beacons identified by device name
+struct EddystoneType {
+  const char *deviceName;
+  const char *name;
+  bool (BleScanner::*decoder)(const AdvertisementView &advert);
+};
+
+const BeaconType *findBeaconType(const AdvertisementView &advert);
+const EddystoneType *findEddystoneType(const AdvertisementView &advert);
+
 extern BleScanner bleScanner;
 
 #endif  // GATEWAY
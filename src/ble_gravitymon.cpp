@@ -23,6 +23,8 @@ SOFTWARE.
  */
 #if defined(ENABLE_BLE) && defined(GRAVITYMON)
 
+#include <array>
+#include <ble_codec.hpp>
 #include <ble_gravitymon.hpp>
 #include <log.hpp>
 #include <string>
@@ -51,39 +53,27 @@ void BleSender::sendEddystoneData(float battery, float tempC, float gravSG,
                                   float angle) {
   Log.info(F("Starting eddystone data transmission" CR));
 
-  char beacon_data[25];
-
-  uint16_t g = gravSG * 10000;
-  uint16_t t = tempC * 1000;
-  uint16_t b = battery * 1000;
-  uint16_t a = angle * 100;
-  uint32_t chipId = 0;
+  GravmonEddystoneFrame frame;
 
   for (int i = 0; i < 17; i = i + 8) {
-    chipId |= ((ESP.getEfuseMac() >> (40 - i)) & 0xff) << i;
+    frame.chipId |= ((ESP.getEfuseMac() >> (40 - i)) & 0xff) << i;
   }
 
-  beacon_data[0] = 0x20;  // Eddystone Frame Type (Unencrypted Eddystone-TLM)
-  beacon_data[1] = 0x00;  // TLM version
-  beacon_data[2] = (b >> 8);
-  beacon_data[3] = (b & 0xFF);
-  beacon_data[4] = (t >> 8);
-  beacon_data[5] = (t & 0xFF);
-  beacon_data[6] = (g >> 8);
-  beacon_data[7] = (g & 0xFF);
-  beacon_data[8] = (a >> 8);
-  beacon_data[9] = (a & 0xFF);
-  beacon_data[10] = ((chipId & 0xFF000000) >> 24);
-  beacon_data[11] = ((chipId & 0xFF0000) >> 16);
-  beacon_data[12] = ((chipId & 0xFF00) >> 8);
-  beacon_data[13] = (chipId & 0xFF);
+  frame.battery = battery;
+  frame.tempC = tempC;
+  frame.gravity = gravSG;
+  frame.angle = angle;
+
+  std::array<uint8_t, GravmonEddystoneFrame::LENGTH> beaconData =
+      encodeFrame(frame);
 
   BLEAdvertisementData advData = BLEAdvertisementData();
   BLEAdvertisementData respData = BLEAdvertisementData();
 
   respData.setFlags(0x06);
   respData.setCompleteServices(BLEUUID("feaa"));
-  respData.setServiceData(BLEUUID("feaa"), std::string(beacon_data, 14));
+  respData.setServiceData(BLEUUID("feaa"), beaconData.data(),
+                          beaconData.size());
 
   advData.setName("gravitymon");
   _advertising->setAdvertisementData(advData);
@@ -150,72 +140,32 @@ void BleSender::sendRaptV1Data(float battery, float tempC, float gravSG, float a
 
   _advertising->stop();
 
-  uint16_t t = (tempC + 273.15) * 128.0;
-  uint16_t b = battery * 256;
-  uint16_t a = angle * 16;
+  RaptV1Frame frame;
   uint32_t chipId = 0;
 
-  union { // For mapping the raw float to bytes
-      float f;
-      uint8_t b[4];
-  } floatUnion;
-
   for (int i = 0; i < 17; i = i + 8) {
     chipId |= ((ESP.getEfuseMac() >> (40 - i)) & 0xff) << i;
   }
 
-  std::string mf = "";
-
-  /*
-    typedef struct __attribute__((packed)) {
-        char prefix[4];        // RAPT
-        uint8_t version;       // always 0x01
-        uint8_t mac[6];
-        uint16_t temperature;  // x / 128 - 273.15
-        float gravity;         // / 1000
-        int16_t x;             // x / 16
-        int16_t y;             // x / 16
-        int16_t z;             // x / 16
-        int16_t battery;       // x / 256
-    } RAPTPillMetricsV1;
-  */
-
-  mf += "RAPT";
-  mf += static_cast<char>(0x01);  // Rapt v1
-
-  mf += static_cast<char>(0x00);  // Mac adress, using that for ChipID
-  mf += static_cast<char>(0x00);  // 
-  mf += static_cast<char>(((chipId & 0xFF000000) >> 24));
-  mf += static_cast<char>(((chipId & 0xFF0000) >> 16));
-  mf += static_cast<char>(((chipId & 0xFF00) >> 8));
-  mf += static_cast<char>((chipId & 0xFF));
-
-  mf += static_cast<char>((t >> 8));  // Temperature
-  mf += static_cast<char>((t & 0xFF));
-
-  floatUnion.f = gravSG * 1000;  // Gravity
-  mf += static_cast<char>(floatUnion.b[3]);
-  mf += static_cast<char>(floatUnion.b[2]);
-  mf += static_cast<char>(floatUnion.b[1]);
-  mf += static_cast<char>(floatUnion.b[0]);
-
-  mf += static_cast<char>((a >> 8));  // X, Angle
-  mf += static_cast<char>((a & 0xFF));
-  mf += static_cast<char>(0x00);  // Y
-  mf += static_cast<char>(0x00); 
-  mf += static_cast<char>(0x00);  // Z
-  mf += static_cast<char>(0x00); 
-
-  mf += static_cast<char>((b >> 8));  // Battery
-  mf += static_cast<char>((b & 0xFF));
+  frame.tempC = tempC;
+  frame.gravity = gravSG;
+  frame.angleX = angle;  // Y and Z are not used
+  frame.battery = battery;
+
+  std::array<uint8_t, RaptV1Frame::LENGTH> mf = encodeFrame(frame);
+
+  // The last four bytes of the mac field carry the chip id, the gateway
+  // identifies RAPT pills by their address so it is not part of the frame
+  for (int i = 0; i < 4; i++)
+    mf[7 + i] = static_cast<uint8_t>(chipId >> (24 - 8 * i));
 
 #if LOG_LEVEL == 6
-  dumpPayload(mf.c_str(), mf.length());
+  dumpPayload(reinterpret_cast<const char*>(mf.data()), mf.size());
 #endif
 
   BLEAdvertisementData advData = BLEAdvertisementData();
   advData.setFlags(0x04);
-  advData.setManufacturerData(mf);
+  advData.setManufacturerData(mf.data(), mf.size());
   _advertising->setAdvertisementData(advData);
 
   _advertising->setConnectableMode(BLE_GAP_CONN_MODE_NON);
@@ -229,71 +179,24 @@ void BleSender::sendRaptV2Data(float battery, float tempC, float gravSG, float a
 
   _advertising->stop();
 
-  union { // For mapping the raw float to bytes
-      float f;
-      uint8_t b[4];
-  } floatUnion;
-
-  uint16_t t = (tempC + 273.15) * 128.0;
-  uint16_t b = battery * 256;
-  uint16_t a = angle * 16;
-
-  std::string mf = "";
-
-  /*
-        typedef struct __attribute__((packed)) {
-            char prefix[4];        // RAPT
-            uint8_t version;       // always 0x02
-            uint8_t padding;       // always 0x00
-            uint8_t gravity_velocity_valid; // boolean
-            float gravity_velocity;
-            uint16_t temperature;  // x / 128 - 273.15
-            float gravity;         // / 1000
-            int16_t x;             // x / 16
-            int16_t y;             // x / 16
-            int16_t z;             // x / 16
-            int16_t battery;       // x / 256
-        } RAPTPillMetricsV2;
-  */
-
-  mf += "RAPT";
-  mf += static_cast<char>(0x02);  // Rapt v2
-  mf += static_cast<char>(0x00);  // Padding
-
-  mf += static_cast<char>(velocityValid ? 0x01 : 0x00);  // Valocity valid
-
-  floatUnion.f = velocity;  // Velocity
-  mf += static_cast<char>(floatUnion.b[3]);
-  mf += static_cast<char>(floatUnion.b[2]);
-  mf += static_cast<char>(floatUnion.b[1]);
-  mf += static_cast<char>(floatUnion.b[0]);
-
-  mf += static_cast<char>((t >> 8));  // Temperature
-  mf += static_cast<char>((t & 0xFF));
-
-  floatUnion.f = gravSG * 1000;  // Gravity
-  mf += static_cast<char>(floatUnion.b[3]);
-  mf += static_cast<char>(floatUnion.b[2]);
-  mf += static_cast<char>(floatUnion.b[1]);
-  mf += static_cast<char>(floatUnion.b[0]);
-
-  mf += static_cast<char>((a >> 8));  // X, Angle
-  mf += static_cast<char>((a & 0xFF));
-  mf += static_cast<char>(0x00);  // Y
-  mf += static_cast<char>(0x00); 
-  mf += static_cast<char>(0x00);  // Z
-  mf += static_cast<char>(0x00); 
-
-  mf += static_cast<char>((b >> 8));  // Battery (batt_v*1000)
-  mf += static_cast<char>((b & 0xFF));
+  RaptV2Frame frame;
+
+  frame.velocityValid = velocityValid;
+  frame.velocity = velocity;
+  frame.tempC = tempC;
+  frame.gravity = gravSG;
+  frame.angleX = angle;  // Y and Z are not used
+  frame.battery = battery;
+
+  std::array<uint8_t, RaptV2Frame::LENGTH> mf = encodeFrame(frame);
 
 #if LOG_LEVEL == 6
-  dumpPayload(mf.c_str(), mf.length());
+  dumpPayload(reinterpret_cast<const char*>(mf.data()), mf.size());
 #endif
 
   BLEAdvertisementData advData = BLEAdvertisementData();
   advData.setFlags(0x04);
-  advData.setManufacturerData(mf);
+  advData.setManufacturerData(mf.data(), mf.size());
   _advertising->setAdvertisementData(advData);
 
   _advertising->setConnectableMode(BLE_GAP_CONN_MODE_NON);
@@ -308,44 +211,26 @@ void BleSender::sendCustomBeaconData(float battery, float tempC, float gravSG,
 
   _advertising->stop();
 
-  uint16_t g = gravSG * 10000;
-  uint16_t t = tempC * 1000;
-  uint16_t b = battery * 1000;
-  uint16_t a = angle * 100;
-  uint32_t chipId = 0;
+  GravmonBeaconFrame frame;
 
   for (int i = 0; i < 17; i = i + 8) {
-    chipId |= ((ESP.getEfuseMac() >> (40 - i)) & 0xff) << i;
+    frame.chipId |= ((ESP.getEfuseMac() >> (40 - i)) & 0xff) << i;
   }
 
-  std::string mf = "";
-
-  mf += static_cast<char>(0x4C);  // Manuf ID (Apple)
-  mf += static_cast<char>(0x00);
-  mf += static_cast<char>(0x03);  // SubType (standards is 0x02)
-  mf += static_cast<char>(0x15);  // SubType Length
-  mf += "GRAVMON.";
-  mf += static_cast<char>(((chipId & 0xFF000000) >> 24));  // Chipid
-  mf += static_cast<char>(((chipId & 0xFF0000) >> 16));
-  mf += static_cast<char>(((chipId & 0xFF00) >> 8));
-  mf += static_cast<char>((chipId & 0xFF));
-  mf += static_cast<char>((a >> 8));  // Angle (angle*100)
-  mf += static_cast<char>((a & 0xFF));
-  mf += static_cast<char>((b >> 8));  // Battery (batt_v*1000)
-  mf += static_cast<char>((b & 0xFF));
-  mf += static_cast<char>((g >> 8));  // Gravity (gravity_sg*10000)
-  mf += static_cast<char>((g & 0xFF));
-  mf += static_cast<char>((t >> 8));  // Temperature (temp_c*1000)
-  mf += static_cast<char>((t & 0xFF));
-  mf += static_cast<char>(0x00);  // Signal
+  frame.angle = angle;
+  frame.battery = battery;
+  frame.gravity = gravSG;
+  frame.tempC = tempC;
+
+  std::array<uint8_t, GravmonBeaconFrame::LENGTH> mf = encodeFrame(frame);
 
 #if LOG_LEVEL == 6
-  dumpPayload(mf.c_str(), mf.length());
+  dumpPayload(reinterpret_cast<const char*>(mf.data()), mf.size());
 #endif
 
   BLEAdvertisementData advData = BLEAdvertisementData();
   advData.setFlags(0x04);
-  advData.setManufacturerData(mf);
+  advData.setManufacturerData(mf.data(), mf.size());
   _advertising->setAdvertisementData(advData);
 
   _advertising->setConnectableMode(BLE_GAP_CONN_MODE_NON);
@@ -23,6 +23,8 @@ SOFTWARE.
  */
 #if defined(ENABLE_BLE) && defined(PRESSUREMON)
 
+#include <array>
+#include <ble_codec.hpp>
 #include <ble_pressuremon.hpp>
 #include <log.hpp>
 #include <string>
@@ -93,44 +95,26 @@ void BleSender::sendCustomBeaconData(float battery, float tempC,
 
   _advertising->stop();
 
-  uint16_t p = pressurePsi * 100;
-  uint16_t p1 = pressurePsi1 * 100;
-  uint16_t t = tempC * 1000;
-  uint16_t b = battery * 1000;
-  uint32_t chipId = 0;
+  PresmonBeaconFrame frame;
 
   for (int i = 0; i < 17; i = i + 8) {
-    chipId |= ((ESP.getEfuseMac() >> (40 - i)) & 0xff) << i;
+    frame.chipId |= ((ESP.getEfuseMac() >> (40 - i)) & 0xff) << i;
   }
 
-  std::string mf = "";
-
-  mf += static_cast<char>(0x4C);  // Manuf ID (Apple)
-  mf += static_cast<char>(0x00);
-  mf += static_cast<char>(0x03);  // SubType (standards is 0x02)
-  mf += static_cast<char>(0x15);  // SubType Length
-  mf += "PRESMON.";
-  mf += static_cast<char>(((chipId & 0xFF000000) >> 24));  // Chipid
-  mf += static_cast<char>(((chipId & 0xFF0000) >> 16));
-  mf += static_cast<char>(((chipId & 0xFF00) >> 8));
-  mf += static_cast<char>((chipId & 0xFF));
-  mf += static_cast<char>((p >> 8));  // Pressure (pressure*10000)
-  mf += static_cast<char>((p & 0xFF));
-  mf += static_cast<char>((p1 >> 8));  // Pressure1 (pressure1*10000)
-  mf += static_cast<char>((p1 & 0xFF));
-  mf += static_cast<char>((b >> 8));  // Battery (batt_v*1000)
-  mf += static_cast<char>((b & 0xFF));
-  mf += static_cast<char>((t >> 8));  // Temperature (temp_c*1000)
-  mf += static_cast<char>((t & 0xFF));
-  mf += static_cast<char>(0x00);  // Signal
+  frame.pressure = pressurePsi;
+  frame.pressure1 = pressurePsi1;
+  frame.battery = battery;
+  frame.tempC = tempC;
+
+  std::array<uint8_t, PresmonBeaconFrame::LENGTH> mf = encodeFrame(frame);
 
 #if LOG_LEVEL == 6
-  dumpPayload(mf.c_str(), mf.length());
+  dumpPayload(reinterpret_cast<const char*>(mf.data()), mf.size());
 #endif
 
   BLEAdvertisementData advData = BLEAdvertisementData();
   advData.setFlags(0x04);
-  advData.setManufacturerData(mf);
+  advData.setManufacturerData(mf.data(), mf.size());
   _advertising->setAdvertisementData(advData);
 
   // _advertising->setAdvertisementType(BLE_GAP_CONN_MODE_NON);
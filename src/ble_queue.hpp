@@ -0,0 +1,124 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_BLE_QUEUE_HPP_
+#define SRC_BLE_QUEUE_HPP_
+
+#if defined(GATEWAY)
+
+#include <atomic>
+#include <ble_advertisement.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Legacy advertising data + scan response (2 x 31 bytes)
+constexpr size_t BLE_MAX_PAYLOAD = 62;
+
+// Raw advert as copied out of the scan callback
+struct RawAdvert {
+  uint32_t timestamp;
+  uint8_t address[BLE_ADDRESS_LENGTH];
+  int8_t rssi;
+  uint8_t length;
+  uint8_t payload[BLE_MAX_PAYLOAD];
+};
+
+// Lock-free single producer / single consumer ring. The producer (NimBLE host
+// task) fills a slot in place and publishes it with commit(), the consumer
+// reads the oldest slot with front() and releases it with pop(). Size must be
+// a power of two, one slot is always kept free.
+template <typename T, size_t Size>
+class SpscRing {
+  static_assert(Size >= 2 && (Size & (Size - 1)) == 0,
+                "Size must be a power of two");
+
+ private:
+  T _slots[Size];
+  std::atomic<uint32_t> _head{0};  // Written by producer
+  std::atomic<uint32_t> _tail{0};  // Written by consumer
+  std::atomic<uint32_t> _pushed{0};
+  std::atomic<uint32_t> _dropped{0};
+  std::atomic<uint32_t> _highWater{0};
+
+ public:
+  // Producer side
+
+  // Returns the slot to fill or nullptr (and counts a drop) if the ring is full
+  T* reserve() {
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    uint32_t tail = _tail.load(std::memory_order_acquire);
+
+    if (head - tail >= Size - 1) {
+      _dropped.store(_dropped.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    return &_slots[head & (Size - 1)];
+  }
+
+  void commit() {
+    uint32_t head = _head.load(std::memory_order_relaxed) + 1;
+    uint32_t used = head - _tail.load(std::memory_order_relaxed);
+
+    _head.store(head, std::memory_order_release);
+    _pushed.store(_pushed.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+    if (used > _highWater.load(std::memory_order_relaxed))
+      _highWater.store(used, std::memory_order_relaxed);
+  }
+
+  // Consumer side
+
+  const T* front() const {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+
+    if (tail == _head.load(std::memory_order_acquire)) return nullptr;
+    return &_slots[tail & (Size - 1)];
+  }
+
+  void pop() {
+    _tail.store(_tail.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+  }
+
+  // Statistics, safe to read from any task
+
+  size_t capacity() const { return Size - 1; }
+  size_t size() const {
+    uint32_t tail = _tail.load(std::memory_order_acquire);
+    return _head.load(std::memory_order_acquire) - tail;
+  }
+  uint32_t getPushed() const { return _pushed.load(std::memory_order_relaxed); }
+  uint32_t getDropped() const {
+    return _dropped.load(std::memory_order_relaxed);
+  }
+  uint32_t getHighWater() const {
+    return _highWater.load(std::memory_order_relaxed);
+  }
+};
+
+#endif  // GATEWAY
+
+#endif  // SRC_BLE_QUEUE_HPP_
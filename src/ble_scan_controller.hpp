@@ -0,0 +1,179 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_BLE_SCAN_CONTROLLER_HPP_
+#define SRC_BLE_SCAN_CONTROLLER_HPP_
+
+#if defined(GATEWAY)
+
+#include <cstdint>
+
+// Bounds and thresholds for the adaptive scan duty cycle. Interval and window
+// are in ms as used by NimBLEScan, window is always <= interval.
+struct ScanControllerConfig {
+  uint16_t minInterval = 97;   // Used at the highest duty cycle
+  uint16_t maxInterval = 293;  // Used at the lowest duty cycle
+  uint16_t minWindow = 37;
+  uint16_t maxWindow = 89;
+  uint32_t staleAfter = 60000;    // Known device counts as missing after ms
+  uint32_t forgetAfter = 900000;  // Missing device is no longer expected
+  uint32_t discoveryHold = 6;     // Windows at full duty after a new device
+  float duplicateRatio = 0.5;     // Needed before the duty is lowered
+};
+
+enum class ScanState { Discovery, Tracking, Steady };
+
+// Metrics for one evaluation (normally one scan window)
+struct ScanMetrics {
+  ScanState state = ScanState::Discovery;
+  uint8_t level = 0;  // 0 = lowest duty cycle, LEVELS - 1 = highest
+  uint16_t interval = 0;
+  uint16_t window = 0;
+  float advertRate = 0;  // Adverts/s received during the last window
+  float duplicateRatio = 0;
+  uint32_t activeDevices = 0;
+  uint32_t staleDevices = 0;
+  uint32_t changes = 0;  // Number of interval/window changes
+  const char* reason = "start";
+};
+
+// Picks scan interval/window from the observed advert load. A new device
+// moves the scanner to full duty (discovery) for a number of windows, a
+// known device that has gone missing raises the duty one step and when all
+// known devices report on schedule and most adverts are duplicates the
+// duty is lowered one step at a time.
+class ScanController {
+ public:
+  static constexpr uint8_t LEVELS = 5;
+
+ private:
+  ScanControllerConfig _config;
+  ScanMetrics _metrics;
+  uint32_t _hold = 0;
+  uint32_t _lastTime = 0;
+  uint32_t _lastAdverts = 0;
+  uint32_t _lastDuplicates = 0;
+  uint32_t _lastNewDevices = 0;
+
+  // Prime intervals reduce the risk of a beat pattern with the advertising
+  // interval of the beacons
+  static uint16_t nextPrime(uint16_t v) {
+    for (;; v++) {
+      bool prime = v > 1;
+      for (uint16_t d = 2; prime && d * d <= v; d++) prime = v % d != 0;
+      if (prime) return v;
+    }
+  }
+
+  static uint16_t lerp(uint16_t low, uint16_t high, uint8_t level) {
+    return nextPrime(low + (static_cast<int>(high) - low) * level /
+                               (LEVELS - 1));
+  }
+
+  void apply(uint8_t level, ScanState state, const char* reason) {
+    uint16_t interval =
+        lerp(_config.maxInterval, _config.minInterval, level);
+    uint16_t window = lerp(_config.minWindow, _config.maxWindow, level);
+
+    if (window > interval) window = interval;
+    if (interval != _metrics.interval || window != _metrics.window)
+      _metrics.changes++;
+
+    _metrics.level = level;
+    _metrics.state = state;
+    _metrics.interval = interval;
+    _metrics.window = window;
+    _metrics.reason = reason;
+  }
+
+ public:
+  ScanController() { apply(LEVELS - 1, ScanState::Discovery, "start"); }
+
+  void setConfig(const ScanControllerConfig& config) {
+    _config = config;
+    apply(_metrics.level, _metrics.state, "config");
+  }
+  const ScanControllerConfig& getConfig() const { return _config; }
+  const ScanMetrics& getMetrics() const { return _metrics; }
+
+  // Called at the end of every scan window with the cumulative counters,
+  // returns true if interval or window should be changed.
+  bool update(uint32_t now, uint32_t adverts, uint32_t duplicates,
+              uint32_t newDevices, uint32_t activeDevices,
+              uint32_t staleDevices) {
+    uint32_t elapsed = now - _lastTime;
+    uint32_t received = adverts - _lastAdverts;
+    uint32_t repeated = duplicates - _lastDuplicates;
+    bool discovered = newDevices != _lastNewDevices;
+
+    _metrics.advertRate = elapsed ? received * 1000.0 / elapsed : 0;
+    _metrics.duplicateRatio =
+        received ? static_cast<float>(repeated) / received : 0;
+    _metrics.activeDevices = activeDevices;
+    _metrics.staleDevices = staleDevices;
+
+    _lastTime = now;
+    _lastAdverts = adverts;
+    _lastDuplicates = duplicates;
+    _lastNewDevices = newDevices;
+
+    uint16_t interval = _metrics.interval;
+    uint16_t window = _metrics.window;
+
+    if (discovered) {
+      _hold = _config.discoveryHold;
+      apply(LEVELS - 1, ScanState::Discovery, "new device");
+    } else if (_hold) {
+      _hold--;
+      apply(LEVELS - 1, ScanState::Discovery, "discovery hold");
+    } else if (staleDevices) {
+      apply(_metrics.level < LEVELS - 1 ? _metrics.level + 1 : _metrics.level,
+            ScanState::Tracking, "device missing");
+    } else if (_metrics.duplicateRatio >= _config.duplicateRatio &&
+               _metrics.level > 0) {
+      apply(_metrics.level - 1, ScanState::Tracking, "on schedule");
+    } else {
+      apply(_metrics.level,
+            _metrics.level ? ScanState::Tracking : ScanState::Steady,
+            _metrics.level ? "hold" : "steady");
+    }
+
+    return interval != _metrics.interval || window != _metrics.window;
+  }
+
+  static const char* stateToString(ScanState state) {
+    switch (state) {
+      case ScanState::Discovery:
+        return "discovery";
+      case ScanState::Tracking:
+        return "tracking";
+      case ScanState::Steady:
+        return "steady";
+    }
+    return "";
+  }
+};
+
+#endif  // GATEWAY
+
+#endif  // SRC_BLE_SCAN_CONTROLLER_HPP_
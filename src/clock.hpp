@@ -0,0 +1,120 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_CLOCK_HPP_
+#define SRC_CLOCK_HPP_
+
+#if defined(GATEWAY)
+
+#include <Arduino.h>
+#include <sys/time.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+
+#if !defined(NATIVE)
+#include <esp_timer.h>
+#endif
+
+// Time before this is treated as not synchronized (2024-01-01)
+constexpr uint32_t CLOCK_MIN_EPOCH = 1704067200;
+
+// Monotonic time in microseconds since boot
+typedef uint64_t (*ClockSource)();
+
+inline uint64_t systemClockSource() {
+#if defined(NATIVE)
+  return micros();  // Follows setNativeMillis() when a capture is replayed
+#else
+  return esp_timer_get_time();
+#endif
+}
+
+// Wall clock built from the monotonic timer and an epoch offset that is
+// captured once, from the system time (NTP) or set manually. Reading the time
+// never blocks and costs one timer read, timestamps are kept as epoch seconds
+// and only formatted when written out. Until the clock is set the epoch is
+// the time since boot (1970-01-01).
+//
+// The offset is a single 32 bit value so it can be read from the scan tasks
+// while it is set from the loop.
+class Clock {
+ private:
+  ClockSource _source = &systemClockSource;
+  volatile uint32_t _offset = 0;  // Epoch seconds at boot
+
+ public:
+  // Replace the time source, used for deterministic runs on the host
+  void setSource(ClockSource source) { _source = source; }
+
+  uint64_t monotonicUs() const { return _source(); }
+  uint32_t uptime() const { return monotonicUs() / 1000000; }
+
+  bool isSet() const { return _offset != 0; }
+
+  void setEpoch(uint32_t epoch) {
+    _offset = epoch - uptime();
+
+#if !defined(NATIVE)
+    // Keep the system time in sync, it is used by the file system
+    struct timeval tv = {static_cast<time_t>(epoch), 0};
+    settimeofday(&tv, nullptr);
+#endif
+  }
+
+  // Takes the offset from the system time once it has been set by NTP,
+  // returns true if the clock is set.
+  bool syncFromSystemTime() {
+    if (isSet()) return true;
+
+    time_t now = time(nullptr);
+
+    if (now < static_cast<time_t>(CLOCK_MIN_EPOCH)) return false;
+
+    _offset = static_cast<uint32_t>(now) - uptime();
+    return true;
+  }
+
+  uint32_t now() const { return _offset + uptime(); }
+  uint64_t nowUs() const {
+    return static_cast<uint64_t>(_offset) * 1000000 + monotonicUs();
+  }
+
+  // Formats epoch seconds as local time, YYYY-MM-DD HH:MM:SS
+  static char* format(uint32_t epoch, char* buf, size_t len) {
+    time_t t = epoch;
+    struct tm time;
+
+    localtime_r(&t, &time);
+    if (strftime(buf, len, "%Y-%m-%d %H:%M:%S", &time) == 0 && len > 0)
+      buf[0] = 0;
+    return buf;
+  }
+};
+
+extern Clock myClock;
+
+#endif  // GATEWAY
+
+#endif  // SRC_CLOCK_HPP_
@@ -0,0 +1,55 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_CRC32_HPP_
+#define SRC_CRC32_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32 (IEEE 802.3, same as zlib), using a 16 entry table to keep the
+// flash footprint small. Start with 0 and feed the data in any number of
+// pieces.
+inline uint32_t crc32Update(uint32_t crc, const void* data, size_t len) {
+  static const uint32_t TABLE[16] = {
+      0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4,
+      0x4db26158, 0x5005713c, 0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+      0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c};
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+
+  crc = ~crc;
+  while (len--) {
+    crc ^= *p++;
+    crc = (crc >> 4) ^ TABLE[crc & 0x0f];
+    crc = (crc >> 4) ^ TABLE[crc & 0x0f];
+  }
+  return ~crc;
+}
+
+inline uint32_t crc32(const void* data, size_t len) {
+  return crc32Update(0, data, len);
+}
+
+#endif  // SRC_CRC32_HPP_
+
+// EOF
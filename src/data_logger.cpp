@@ -0,0 +1,928 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#if defined(GATEWAY)
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <data_logger.hpp>
+#include <log.hpp>
+#include <vector>
+
+DataLogger myDataLogger;
+
+namespace {
+
+constexpr char MANIFEST_NAME[] = "manifest.txt";
+
+struct ManifestEntry {
+  char name[24];
+  uint32_t first;
+  uint32_t last;
+};
+
+// Existing files are opened for update so that recovery can overwrite a torn
+// end, the writes continue at the position set by startFile()
+File openForAppend(FS* fs, const char* path) {
+  if (fs->exists(path)) return fs->open(path, "r+");
+  return fs->open(path, FILE_WRITE, true);
+}
+
+// Tag of the device key for the type of a record, Tilt and Tilt Pro share
+// the key like in MeasurementBaseData::getKey()
+MeasurementType logTag(uint8_t type) {
+  return type == MeasurementType::TiltPro
+             ? MeasurementType::Tilt
+             : static_cast<MeasurementType>(type);
+}
+
+// The index of a .dat file has the same name with .idx
+void indexPath(const char* path, char* buf, size_t len) {
+  snprintf(buf, len, "%s", path);
+
+  char* ext = strrchr(buf, '.');
+  if (ext && strlen(ext) == 4) memcpy(ext, ".idx", 4);
+}
+
+// Reads the manifest of a partitioned log, one entry per file
+bool readManifest(FS* fs, const char* dir, std::vector<ManifestEntry>* files) {
+  char path[48], line[64];
+  snprintf(path, sizeof(path), "%s/%s", dir, MANIFEST_NAME);
+
+  File manifest = fs->open(path, FILE_READ);
+  if (!manifest) return false;
+
+  size_t len = 0;
+  int c;
+
+  while ((c = manifest.read()) >= 0) {
+    if (c != '\n') {
+      if (len < sizeof(line) - 1) line[len++] = c;
+      continue;
+    }
+
+    ManifestEntry entry;
+    unsigned int first, last;
+    line[len] = 0;
+    len = 0;
+
+    if (sscanf(line, "%23s %u %u", entry.name, &first, &last) != 3) continue;
+    entry.first = first;
+    entry.last = last;
+
+    // Later lines replace the entry of the same file
+    bool found = false;
+    for (ManifestEntry& e : *files) {
+      if (!strcmp(e.name, entry.name)) {
+        e = entry;
+        found = true;
+      }
+    }
+    if (!found) files->push_back(entry);
+  }
+  manifest.close();
+  return true;
+}
+
+}  // namespace
+
+bool DataLogger::begin(FS* fs, const char* path, DataLogFormat format) {
+  end();
+
+  _file = openForAppend(fs, path);
+  if (!_file) {
+    Log.error(F("SD  : Failed to open %s for writing." CR), path);
+    return false;
+  }
+
+  _partitioned = false;
+  _format = format;
+  if (!startSeries()) {
+    _file.close();
+    return false;
+  }
+  startFile();
+  _open = true;
+  startTask();
+
+  Log.notice(F("SD  : Logging to %s, %u bytes in file." CR), path, _offset);
+  return true;
+}
+
+bool DataLogger::beginPartitioned(FS* fs, const char* dir,
+                                  DataLogFormat format) {
+  end();
+
+  if (!fs->exists(dir) && !fs->mkdir(dir)) {
+    Log.error(F("SD  : Failed to create %s." CR), dir);
+    return false;
+  }
+
+  _fs = fs;
+  snprintf(&_dir[0], sizeof(_dir), "%s", dir);
+  _path[0] = 0;
+  _partitioned = true;
+  _format =
+      format == DataLogFormat::Compressed ? format : DataLogFormat::Binary;
+  if (!startSeries()) return false;
+  recoverOpenFiles();
+  _open = true;
+  startTask();
+
+  Log.notice(F("SD  : Logging to %s, one file per day." CR), dir);
+  return true;
+}
+
+bool DataLogger::startSeries() {
+  if (_format != DataLogFormat::Compressed) {
+    _series.reset();
+    _seriesIndex.reset();
+    return true;
+  }
+
+  if (!_series) {
+    _series = allocateBuffer<SeriesEncoder>(DATA_LOGGER_SERIES);
+    _seriesIndex.reset(new DeviceIndex<uint16_t>(DATA_LOGGER_SERIES));
+  }
+  if (!_series) {
+    Log.error(F("SD  : Not enough memory for %d series." CR),
+              DATA_LOGGER_SERIES);
+    return false;
+  }
+
+  for (int i = 0; i < DATA_LOGGER_SERIES; i++) _series[i].clear();
+  _seriesIndex->clear();
+  return true;
+}
+
+void DataLogger::startTask() {
+#if !defined(NATIVE)
+  if (!_lock) _lock = xSemaphoreCreateMutex();
+
+  if (!_task) {
+    // Same core as the BLE consumer, SD writes must not delay the NimBLE host
+    xTaskCreatePinnedToCore(flushTask, "dataLogger", 4096, this, 1, &_task,
+                            1);
+  }
+#endif
+}
+
+// Continues at the end of the opened file
+void DataLogger::startFile() {
+  _offset = _file.size();
+  if (_allocated != UINT32_MAX) _allocated = 0;
+  _used = 0;
+  _dirty = false;
+
+  if (isBinary()) {
+    uint8_t record[BINARY_RECORD_SIZE] = {0};
+    bool recovered = _offset > 0 && recover();
+
+    if (_partitioned) recoverIndex();
+    _file.seek(_offset);
+    alignTarget();
+    _encoder.reset();
+
+    if (_offset == 0) {
+      append(record,
+             _encoder.encodeHeader(myClock.now(), record,
+                                   _format == DataLogFormat::Compressed
+                                       ? BINARY_LOG_VERSION_SERIES
+                                       : BINARY_LOG_VERSION));
+    } else if (!recovered) {
+      // Pads a torn record and adds empty slots, so that the reader drops a
+      // block left unfinished by a power loss instead of the next one. A torn
+      // series record takes its payload from the slots that follow it.
+      append(record, (BINARY_RECORD_SIZE - _offset % BINARY_RECORD_SIZE) %
+                         BINARY_RECORD_SIZE);
+      for (uint32_t i = 0; i <= BINARY_SERIES_SLOTS; i++)
+        append(record, BINARY_RECORD_SIZE);
+    }
+  } else {
+    alignTarget();
+
+    // Ends a line torn by a power loss so that it does not swallow the next
+    if (_offset > 0) {
+      _file.seek(_offset - 1);
+      int last = _file.read();
+      _file.seek(_offset);
+      if (last != '\n') append("\r\n", 2);
+    }
+  }
+}
+
+// Finds the last block end in the final DATA_LOGGER_RECOVERY_WINDOW bytes
+// whose count and CRC match the records before it. Returns the offset after
+// it, the header if the file has no blocks yet, or UINT32_MAX if there is
+// none in the window. The file is read backwards in buffer sized chunks, a
+// chunk keeps the start of the last block of the previous one.
+uint32_t DataLogger::findCommit(uint32_t size) {
+  constexpr uint32_t BLOCK_SIZE = BINARY_BLOCK_RECORDS * BINARY_RECORD_SIZE;
+  uint32_t limit =
+      size > DATA_LOGGER_RECOVERY_WINDOW ? size - DATA_LOGGER_RECOVERY_WINDOW
+                                         : 0;
+  uint32_t end = size - size % BINARY_RECORD_SIZE;
+
+  while (end > limit) {
+    uint32_t start =
+        end > DATA_LOGGER_BUFFER_SIZE ? end - DATA_LOGGER_BUFFER_SIZE : 0;
+
+    if (!_file.seek(start) ||
+        _file.read(_buffer, end - start) != end - start)
+      return UINT32_MAX;
+
+    for (uint32_t pos = end - BINARY_RECORD_SIZE;; pos -= BINARY_RECORD_SIZE) {
+      // A block end further down may need records of the previous chunk
+      if (start > 0 && pos < start + BLOCK_SIZE) break;
+
+      const uint8_t* slot = &_buffer[pos - start];
+      BinaryBlockEndRecord blockEnd;
+      memcpy(&blockEnd, slot, sizeof(blockEnd));
+
+      if (slot[0] == BinaryBlockEnd && blockEnd.count > 0 &&
+          blockEnd.count <= BINARY_BLOCK_RECORDS &&
+          blockEnd.count * BINARY_RECORD_SIZE <= pos - start &&
+          crc32(slot - blockEnd.count * BINARY_RECORD_SIZE,
+                blockEnd.count * BINARY_RECORD_SIZE) == blockEnd.crc)
+        return pos + BINARY_RECORD_SIZE;
+
+      if (start == 0 && pos == 0) {
+        BinaryHeaderRecord header;
+        memcpy(&header, slot, sizeof(header));
+        return slot[0] == BinaryHeader && header.magic == BINARY_LOG_MAGIC
+                   ? BINARY_RECORD_SIZE
+                   : UINT32_MAX;
+      }
+      if (pos == start) break;
+    }
+
+    if (start == 0) break;
+    end = start + BLOCK_SIZE;
+  }
+
+  return UINT32_MAX;
+}
+
+// Continues a binary file after its last complete block. The data after it
+// was never confirmed by a flush, it is cleared to empty slots and
+// overwritten by the next writes. Only the end of the file is read, so the
+// time taken does not depend on the size of the file.
+bool DataLogger::recover() {
+  uint32_t start = millis();
+  uint32_t size = _offset;
+  uint32_t commit = findCommit(size);
+
+  if (commit == UINT32_MAX) {
+    Log.warning(F("SD  : No complete block at the end of %s." CR),
+                _file.path());
+    _file.seek(size);
+    return false;
+  }
+
+  if (commit < size) {
+    memset(_buffer, 0, sizeof(_buffer));
+    _file.seek(commit);
+
+    for (uint32_t pos = commit; pos < size;) {
+      uint32_t n = size - pos < sizeof(_buffer) ? size - pos : sizeof(_buffer);
+
+      if (_file.write(_buffer, n) != n) {
+        _metrics.errors++;
+        break;
+      }
+      pos += n;
+    }
+    _file.flush();
+    _metrics.recovered += size - commit;
+
+    Log.notice(
+        F("SD  : Dropped %u bytes after the last block of %s in %u ms." CR),
+        size - commit, _file.path(), millis() - start);
+  }
+
+  _offset = commit;
+  return true;
+}
+
+void DataLogger::end() {
+  if (!_open) return;
+
+  flush();
+
+#if !defined(NATIVE)
+  xSemaphoreTake(_lock, portMAX_DELAY);
+#endif
+  if (_partitioned)
+    closeFile();
+  else
+    _file.close();
+  _open = false;
+#if !defined(NATIVE)
+  xSemaphoreGive(_lock);
+#endif
+}
+
+void DataLogger::onMeasurement(int, const MeasurementSnapshot& snapshot) {
+  if (!_open) return;
+
+  Measurement* measurement = _queue.reserve();
+  if (measurement == nullptr) return;  // Counted as dropped by the queue
+
+  *measurement = snapshot.measurement;
+  _queue.commit();
+
+  if (_queue.size() >= DATA_LOGGER_QUEUE_SIZE / 2) {
+#if !defined(NATIVE)
+    if (_task) xTaskNotifyGive(_task);
+#else
+    process();  // There is no flush task on the host
+#endif
+  }
+}
+
+void DataLogger::process(bool force) {
+#if !defined(NATIVE)
+  if (!_lock) return;
+  xSemaphoreTake(_lock, portMAX_DELAY);
+#endif
+
+  if (_open) {
+    const Measurement* measurement;
+    union {
+      char line[MEASUREMENT_CSV_LENGTH];
+      uint8_t records[BinaryLogEncoder::MAX_OUTPUT];
+    } out;
+
+    while ((measurement = _queue.front()) != nullptr) {
+      if (_partitioned) {
+        uint32_t time = measurement->getData()->getCreated();
+
+        if (needsRotation(time) && !openFile(time)) {
+          _queue.pop();
+          _metrics.errors++;
+          continue;
+        }
+
+        if (!_encoder.hasOpenBlock() &&
+            _sinceIndex >= DATA_LOGGER_INDEX_INTERVAL)
+          addIndex(time);
+        _sinceIndex++;
+        _fileLast = time;
+      }
+
+      if (_format == DataLogFormat::Compressed) {
+        addSample(*measurement);
+      } else {
+        size_t len = _format == DataLogFormat::Binary
+                         ? _encoder.encode(*measurement, out.records)
+                         : measurement->formatCsv(out.line, sizeof(out.line));
+        append(&out, len);
+      }
+      _queue.pop();
+      _metrics.records++;
+    }
+
+    if (_format == DataLogFormat::Compressed) writeOldSeries(force);
+
+    if (_dirty &&
+        (force || millis() - _firstPending >= DATA_LOGGER_FLUSH_INTERVAL)) {
+      // Closes the block so that everything written can be verified
+      if (isBinary()) append(out.records, _encoder.endBlock(out.records));
+      write(true);
+    }
+  }
+
+#if !defined(NATIVE)
+  xSemaphoreGive(_lock);
+#endif
+}
+
+// Adds the measurement to the series of its device. Older samples are
+// written before a new name or token, so they keep the texts they came with.
+void DataLogger::addSample(const Measurement& measurement) {
+  BinaryDataRecord record;
+  DeviceKey key = measurement.getData()->getKey();
+
+  if (!toBinaryRecord(measurement, &record)) return;
+
+  if (_encoder.hasNewTexts(measurement)) {
+    uint8_t out[BinaryLogEncoder::MAX_OUTPUT];
+    uint16_t* slot = _seriesIndex->find(key);
+
+    if (slot) writeSeries(*slot);
+    append(out, _encoder.encodeTexts(measurement, out));
+  }
+
+  uint16_t* slot = _seriesIndex->find(key);
+
+  if (slot && _series[*slot].add(record)) return;
+  if (slot) writeSeries(*slot);  // Payload full
+
+  // Takes a free encoder, or the one with the oldest samples
+  uint16_t target = 0;
+
+  for (uint16_t i = 0; i < DATA_LOGGER_SERIES; i++) {
+    if (_series[i].empty()) {
+      target = i;
+      break;
+    }
+    if (_series[i].getFirst() < _series[target].getFirst()) target = i;
+  }
+
+  if (!_series[target].empty()) writeSeries(target);
+  _seriesIndex->insert(key, target);
+  _series[target].add(record);
+}
+
+void DataLogger::writeSeries(uint16_t slot) {
+  SeriesEncoder& series = _series[slot];
+  uint8_t out[BinaryLogEncoder::MAX_SERIES_OUTPUT];
+
+  if (series.empty()) return;
+
+  BinarySeriesRecord header = series.header();
+  append(out, _encoder.encodeSeries(header, series.getPayload(), out));
+
+  _seriesIndex->erase(series.getKey());
+  series.clear();
+}
+
+void DataLogger::writeOldSeries(bool all) {
+  uint32_t now = myClock.now();
+
+  for (uint16_t i = 0; i < DATA_LOGGER_SERIES; i++) {
+    if (!_series[i].empty() &&
+        (all || now - _series[i].getFirst() >= DATA_LOGGER_SERIES_AGE))
+      writeSeries(i);
+  }
+}
+
+void DataLogger::append(const void* data, size_t len) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+
+  if (len == 0) return;
+
+  if (!_dirty) {
+    _dirty = true;
+    _firstPending = millis();
+  }
+
+  // Data crossing the end of the buffer is split over two blocks
+  while (len > 0) {
+    size_t n = len < _target - _used ? len : _target - _used;
+
+    memcpy(&_buffer[_used], p, n);
+    _used += n;
+    p += n;
+    len -= n;
+
+    if (_used == _target) write(false);
+  }
+}
+
+void DataLogger::write(bool sync) {
+  uint32_t start = micros();
+
+  if (_used > 0) {
+    size_t written = _io ? _io->write(_file, _buffer, _used)
+                         : _file.write(_buffer, _used);
+
+    if (written != _used) {
+      _metrics.errors++;
+      Log.error(F("SD  : Failed to write %u bytes to data file." CR), _used);
+    }
+
+    _offset += written;
+    _metrics.bytesWritten += written;
+    _metrics.writes++;
+    _used = 0;
+    alignTarget();
+    preallocate();
+  }
+
+  if (sync) {
+    if (_partitioned) {
+      writeIndex();
+      syncFile(_index);
+    }
+    syncFile(_file);
+    _metrics.flushes++;
+    _dirty = false;
+  }
+
+  uint32_t elapsed = micros() - start;
+  _metrics.lastFlushTime = elapsed;
+  _metrics.totalFlushTime += elapsed;
+  if (elapsed > _metrics.maxFlushTime) _metrics.maxFlushTime = elapsed;
+}
+
+void DataLogger::syncFile(File& file) {
+  if (_io)
+    _io->sync(file);
+  else
+    file.flush();
+}
+
+// Keeps DATA_LOGGER_PREALLOCATE bytes reserved ahead of the end of the file,
+// renewed when half of it is used
+void DataLogger::preallocate() {
+  if (DATA_LOGGER_PREALLOCATE == 0 || !_io || _allocated == UINT32_MAX ||
+      _offset + DATA_LOGGER_PREALLOCATE / 2 < _allocated)
+    return;
+
+  if (_io->preallocate(_file, _offset, DATA_LOGGER_PREALLOCATE)) {
+    _allocated = _offset + DATA_LOGGER_PREALLOCATE;
+  } else {
+    Log.notice(F("SD  : Storage does not support preallocation." CR));
+    _allocated = UINT32_MAX;
+  }
+}
+
+// After a partial write the next block is shortened so that it ends on a
+// sector boundary of the file again.
+void DataLogger::alignTarget() {
+  _target = DATA_LOGGER_BUFFER_SIZE - _offset % DATA_LOGGER_SECTOR_SIZE;
+}
+
+// A new file is started every day, when the file is full and when the clock
+// has gone backwards, so the records of a file are in time order.
+bool DataLogger::needsRotation(uint32_t time) const {
+  return !_file || time >= _dayEnd || time < _fileLast ||
+         _offset + _used >= DATA_LOGGER_MAX_FILE_SIZE;
+}
+
+bool DataLogger::openFile(uint32_t time) {
+  char created[20];
+  bool resume = _path[0] == 0;  // First file since begin
+
+  closeFile();
+
+  Clock::format(time, created, sizeof(created));
+  memcpy(&_day[0], created, sizeof(_day) - 1);  // YYYY-MM-DD
+
+  time_t t = time;
+  struct tm day;
+  localtime_r(&t, &day);
+  day.tm_hour = day.tm_min = day.tm_sec = 0;
+  day.tm_mday++;
+  day.tm_isdst = -1;
+  _dayEnd = mktime(&day);
+
+  // After a restart the last file of the day is continued if it is not full
+  // and was closed with records no newer than time, so that the file stays
+  // in time order (the clock may have been reset by the restart). Otherwise
+  // the next free part is used.
+  char last[sizeof(_path)] = {0};
+  size_t lastSize = 0;
+
+  for (int part = 0;; part++) {
+    if (part)
+      snprintf(&_path[0], sizeof(_path), "%s/%s-%d.dat", _dir, _day, part);
+    else
+      snprintf(&_path[0], sizeof(_path), "%s/%s.dat", _dir, _day);
+
+    if (!_fs->exists(_path)) break;
+
+    File file = _fs->open(_path, FILE_READ);
+    lastSize = file.size();
+    file.close();
+    memcpy(last, _path, sizeof(last));
+  }
+
+  if (resume && last[0] && lastSize < DATA_LOGGER_MAX_FILE_SIZE &&
+      canContinue(strrchr(last, '/') + 1, time))
+    memcpy(_path, last, sizeof(_path));
+
+  char index[sizeof(_path)];
+  indexPath(_path, index, sizeof(index));
+
+  _fileFirst = time;
+  _fileLast = time;
+
+  // A continued file keeps its first time, from the first index entry
+  File first = _fs->open(index, FILE_READ);
+  if (first) {
+    DataLogIndexEntry entry;
+    if (first.read(reinterpret_cast<uint8_t*>(&entry), sizeof(entry)) ==
+        sizeof(entry))
+      _fileFirst = entry.time;
+    first.close();
+  }
+
+  _file = openForAppend(_fs, _path);
+  _index = openForAppend(_fs, index);
+  if (!_file || !_index) {
+    Log.error(F("SD  : Failed to open %s for writing." CR), _path);
+    _file.close();
+    _index.close();
+    return false;
+  }
+
+  startFile();
+  _indexCount = 0;
+  _sinceIndex = DATA_LOGGER_INDEX_INTERVAL;  // Index the first block
+  _metrics.files++;
+  writeManifest(UINT32_MAX);
+
+  Log.notice(F("SD  : Logging to %s, %u bytes in file." CR), _path, _offset);
+  return true;
+}
+
+// The last time of a file is only known if it was closed by end(), a file
+// recovered after a power loss is not continued
+bool DataLogger::canContinue(const char* name, uint32_t time) const {
+  std::vector<ManifestEntry> files;
+
+  if (!readManifest(_fs, _dir, &files)) return false;
+
+  for (const ManifestEntry& entry : files) {
+    if (!strcmp(entry.name, name))
+      return entry.last != UINT32_MAX && entry.last <= time;
+  }
+  return false;
+}
+
+void DataLogger::closeFile() {
+  if (!_file) return;
+
+  // The samples of a file stay in it
+  if (_format == DataLogFormat::Compressed) writeOldSeries(true);
+
+  uint8_t record[BINARY_RECORD_SIZE];
+  append(record, _encoder.endBlock(record));
+  write(true);
+  writeManifest(_fileLast);
+
+  _file.close();
+  _index.close();
+}
+
+// Files still marked as written in the manifest were not closed by end().
+// Their ends are recovered now, the next measurement may start another file.
+void DataLogger::recoverOpenFiles() {
+  std::vector<ManifestEntry> files;
+
+  if (!readManifest(_fs, _dir, &files)) return;
+
+  for (const ManifestEntry& entry : files) {
+    char index[sizeof(_path)];
+
+    if (entry.last != UINT32_MAX) continue;
+
+    snprintf(&_path[0], sizeof(_path), "%s/%s", _dir, entry.name);
+    indexPath(_path, index, sizeof(index));
+    if (!_fs->exists(_path)) continue;
+
+    _file = _fs->open(_path, "r+");
+    _index = openForAppend(_fs, index);
+    if (_file && _index) {
+      _offset = _file.size();
+      if (_offset > 0) recover();
+      recoverIndex();
+    }
+    _file.close();
+    _index.close();
+  }
+
+  _path[0] = 0;
+}
+
+// Clears the index entries that point past the recovered end of the data
+// file, the index continues after the last valid one. Entries are written
+// in offset order, so only the end of the index is read.
+void DataLogger::recoverIndex() {
+  uint32_t size = _index.size();
+  uint32_t end = size - size % sizeof(DataLogIndexEntry);
+  uint32_t keep = end;
+
+  while (keep > 0) {
+    uint32_t start = keep > sizeof(_indexPending) ? keep - sizeof(_indexPending)
+                                                  : 0;
+    uint32_t n = (keep - start) / sizeof(DataLogIndexEntry);
+
+    _index.seek(start);
+    if (_index.read(reinterpret_cast<uint8_t*>(&_indexPending[0]),
+                    keep - start) != keep - start)
+      break;
+
+    while (n > 0 && _indexPending[n - 1].offset > _offset) n--;
+    keep = start + n * sizeof(DataLogIndexEntry);
+    if (n > 0) break;
+  }
+
+  // Cleared entries have offset 0 and are skipped by the query
+  if (keep < size) {
+    memset(&_indexPending[0], 0, sizeof(_indexPending));
+    _index.seek(keep);
+
+    for (uint32_t pos = keep; pos < size;) {
+      uint32_t n = size - pos < sizeof(_indexPending) ? size - pos
+                                                      : sizeof(_indexPending);
+
+      if (_index.write(reinterpret_cast<const uint8_t*>(&_indexPending[0]),
+                       n) != n) {
+        _metrics.errors++;
+        break;
+      }
+      pos += n;
+    }
+    _index.flush();
+  }
+
+  _index.seek(keep);
+}
+
+void DataLogger::addIndex(uint32_t time) {
+  if (_indexCount == INDEX_BUFFER_SIZE) writeIndex();
+
+  _indexPending[_indexCount].time = time;
+  _indexPending[_indexCount].offset = _offset + _used;
+  _indexCount++;
+  _sinceIndex = 0;
+}
+
+void DataLogger::writeIndex() {
+  if (_indexCount == 0) return;
+
+  size_t len = _indexCount * sizeof(DataLogIndexEntry);
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(&_indexPending[0]);
+  if ((_io ? _io->write(_index, data, len) : _index.write(data, len)) != len)
+    _metrics.errors++;
+  _indexCount = 0;
+}
+
+// Appends "<file> <first> <last>" to the manifest, the last line for a file
+// is the valid one. The last time is UINT32_MAX while the file is written.
+void DataLogger::writeManifest(uint32_t last) {
+  char path[sizeof(_dir) + sizeof(MANIFEST_NAME) + 1], line[64];
+
+  snprintf(path, sizeof(path), "%s/%s", _dir, MANIFEST_NAME);
+  File manifest = _fs->open(path, FILE_APPEND, true);
+  if (!manifest) {
+    _metrics.errors++;
+    Log.error(F("SD  : Failed to update %s." CR), path);
+    return;
+  }
+
+  int n = snprintf(line, sizeof(line), "%s %u %u\n", strrchr(_path, '/') + 1,
+                   _fileFirst, last);
+  manifest.write(reinterpret_cast<const uint8_t*>(line), n);
+  manifest.close();
+}
+
+int DataLogger::query(const DeviceKey& key, uint32_t from, uint32_t to,
+                      DataLogVisitor* visitor) {
+  if (!_partitioned) return -1;
+
+  std::vector<ManifestEntry> files;
+  if (!readManifest(_fs, _dir, &files)) return -1;
+
+  int count = 0;
+  bool stopped = false;
+
+  for (const ManifestEntry& entry : files) {
+    if (entry.last < from || entry.first > to) continue;
+
+    int n = queryFile(entry.name, key, from, to, visitor, &stopped);
+    if (n > 0) count += n;
+    if (stopped) break;
+  }
+
+  return count;
+}
+
+int DataLogger::queryFile(const char* name, const DeviceKey& key,
+                          uint32_t from, uint32_t to, DataLogVisitor* visitor,
+                          bool* stopped) {
+  char path[sizeof(_path)], index[sizeof(_path)];
+  uint32_t offset = 0;
+
+  snprintf(path, sizeof(path), "%s/%s", _dir, name);
+  indexPath(path, index, sizeof(index));
+
+  // Starts at the last indexed block that begins before from, all records
+  // in front of it are older
+  File indexFile = _fs->open(index, FILE_READ);
+  if (indexFile) {
+    DataLogIndexEntry entries[32];
+    size_t n;
+    bool found = false;
+
+    while (!found && (n = indexFile.read(reinterpret_cast<uint8_t*>(entries),
+                                         sizeof(entries))) > 0) {
+      for (size_t i = 0; i < n / sizeof(DataLogIndexEntry); i++) {
+        if (entries[i].offset == 0) continue;  // Cleared by recovery
+        if (entries[i].time >= from) {
+          found = true;
+          break;
+        }
+        offset = entries[i].offset;
+      }
+    }
+    indexFile.close();
+  }
+
+  File file = _fs->open(path, FILE_READ);
+  if (!file) return -1;
+  if (offset && !file.seek(offset)) return 0;
+
+  BinaryLogReader reader;
+  uint8_t chunk[16 * BINARY_RECORD_SIZE];
+  size_t n;
+  int count = 0;
+  bool done = false;
+
+  while (!done && (n = file.read(chunk, sizeof(chunk))) >= BINARY_RECORD_SIZE) {
+    for (size_t o = 0; !done && o + BINARY_RECORD_SIZE <= n;
+         o += BINARY_RECORD_SIZE) {
+      if (reader.add(&chunk[o]) != BinaryLogReader::Block) continue;
+
+      for (uint32_t i = 0; !done && i < reader.size(); i += reader.slots(i)) {
+        BinaryDataRecord record;
+
+        if (reader.record(i)[0] == BinarySeries) {
+          BinarySeriesRecord header;
+          memcpy(&header, reader.record(i), sizeof(header));
+
+          if (header.id == key.id && header.last >= from &&
+              header.first <= to && logTag(header.type) == key.tag) {
+            SeriesDecoder decoder(header, reader.record(i + 1));
+
+            while (!done && decoder.next(&record)) {
+              if (record.created < from || record.created > to) continue;
+              count++;
+              if (!visitor->onRecord(record)) done = *stopped = true;
+            }
+          }
+
+          // Later series hold samples from DATA_LOGGER_SERIES_AGE before
+          // they were written at the earliest
+          if (header.last > to && header.last - to > 2 * DATA_LOGGER_SERIES_AGE)
+            done = true;
+          continue;
+        }
+
+        if (reader.record(i)[0] != BinaryData) continue;
+        memcpy(&record, reader.record(i), sizeof(record));
+
+        // Records are in time order within a file
+        if (record.created > to) {
+          done = true;
+        } else if (record.created >= from && record.id == key.id &&
+                   logTag(record.type) == key.tag) {
+          count++;
+          if (!visitor->onRecord(record)) done = *stopped = true;
+        }
+      }
+    }
+  }
+
+  file.close();
+  return count;
+}
+
+DataLoggerMetrics DataLogger::getMetrics() const {
+  DataLoggerMetrics metrics = _metrics;
+
+  metrics.dropped = _queue.getDropped();
+  metrics.queueHighWater = _queue.getHighWater();
+  return metrics;
+}
+
+#if !defined(NATIVE)
+void DataLogger::flushTask(void* parameter) {
+  DataLogger* logger = static_cast<DataLogger*>(parameter);
+
+  while (true) {
+    // Woken when the queue is half full, otherwise checks the flush interval
+    // once a second
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+    logger->process();
+  }
+}
+#endif
+
+#endif  // GATEWAY
+
+// EOF
@@ -0,0 +1,283 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_DATA_LOGGER_HPP_
+#define SRC_DATA_LOGGER_HPP_
+
+#if defined(GATEWAY)
+
+#include <FS.h>
+
+#include <ble_queue.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <measurement.hpp>
+#include <measurement_binary.hpp>
+#include <measurement_index.hpp>
+#include <measurement_series.hpp>
+#include <memory>
+#include <storage.hpp>
+
+// Measurements waiting for the flush task, must be a power of two
+#if !defined(DATA_LOGGER_QUEUE_SIZE)
+#define DATA_LOGGER_QUEUE_SIZE 32
+#endif
+
+// Size of the write buffer, the file is written in blocks of this size
+#if !defined(DATA_LOGGER_BUFFER_SIZE)
+#define DATA_LOGGER_BUFFER_SIZE 4096
+#endif
+
+// Longest time (ms) a measurement stays in memory before it is written
+#if !defined(DATA_LOGGER_FLUSH_INTERVAL)
+#define DATA_LOGGER_FLUSH_INTERVAL 10000
+#endif
+
+// Partitioned log: a new file is started when the current one reaches this
+// size, in addition to every day
+#if !defined(DATA_LOGGER_MAX_FILE_SIZE)
+#define DATA_LOGGER_MAX_FILE_SIZE 4194304
+#endif
+
+// Partitioned log: records between the entries of the time index
+#if !defined(DATA_LOGGER_INDEX_INTERVAL)
+#define DATA_LOGGER_INDEX_INTERVAL 64
+#endif
+
+// Compressed log: devices with samples waiting for their series record
+#if !defined(DATA_LOGGER_SERIES)
+#define DATA_LOGGER_SERIES MEASUREMENT_CAPACITY
+#endif
+
+// Compressed log: longest time (s) the samples of a device are held in memory
+// before their series record is written
+#if !defined(DATA_LOGGER_SERIES_AGE)
+#define DATA_LOGGER_SERIES_AGE 900
+#endif
+
+// Bytes at the end of a binary file searched for the last complete block
+// when it is opened again, bounds the time spent on recovery
+#if !defined(DATA_LOGGER_RECOVERY_WINDOW)
+#define DATA_LOGGER_RECOVERY_WINDOW 16384
+#endif
+
+// Space reserved ahead of the end of the file when the storage backend can
+// do so without changing the file size, 0 disables it
+#if !defined(DATA_LOGGER_PREALLOCATE)
+#define DATA_LOGGER_PREALLOCATE 1048576
+#endif
+
+// Writes are aligned to the sector size of the card
+constexpr size_t DATA_LOGGER_SECTOR_SIZE = 512;
+
+static_assert(DATA_LOGGER_BUFFER_SIZE % DATA_LOGGER_SECTOR_SIZE == 0,
+              "DATA_LOGGER_BUFFER_SIZE must be a multiple of the sector size");
+
+enum class DataLogFormat {
+  Csv,        // v1 text lines
+  Binary,     // Fixed size records, see measurement_binary.hpp
+  Compressed  // Binary with series records, see measurement_series.hpp
+};
+
+// Entry in the sparse time index (.idx) of a partitioned log file. The offset
+// is the start of a block of records, all records before it are older than
+// the time. Entries cleared by recovery are all zero.
+struct DataLogIndexEntry {
+  uint32_t time;    // Epoch seconds of the first record in the block
+  uint32_t offset;  // Byte offset in the .dat file
+};
+
+// Receives the records found by DataLogger::query()
+class DataLogVisitor {
+ public:
+  virtual ~DataLogVisitor() {}
+  // Return false to stop the query
+  virtual bool onRecord(const BinaryDataRecord& record) = 0;
+};
+
+struct DataLoggerMetrics {
+  uint32_t records = 0;       // Measurements added to the write buffer
+  uint32_t dropped = 0;       // Measurements lost because the queue was full
+  uint32_t queueHighWater = 0;
+  uint32_t writes = 0;        // Blocks written to the file
+  uint32_t flushes = 0;       // File flushes (directory / FAT updates)
+  uint32_t errors = 0;
+  uint32_t files = 0;         // Files started by the partitioned log
+  uint32_t recovered = 0;     // Bytes dropped after the last complete block
+  uint64_t bytesWritten = 0;
+  uint32_t lastFlushTime = 0;  // us for the last write + flush
+  uint32_t maxFlushTime = 0;
+  uint64_t totalFlushTime = 0;
+};
+
+// Write-behind logger for the data file. Measurements are pushed as an
+// observer of the measurement list into a lock-free queue, a background task
+// formats them into a write buffer and appends the buffer to the file. The
+// file is kept open, written in sector aligned blocks when the buffer is full
+// and flushed when the oldest pending line is DATA_LOGGER_FLUSH_INTERVAL old,
+// so the card sees one directory update per group of lines instead of one
+// open/append/close per advert.
+//
+// In the binary formats every flush closes the open block, so its block end
+// with the count and CRC of the records is a commit marker. When a binary
+// file is opened again only its last DATA_LOGGER_RECOVERY_WINDOW bytes are
+// searched for the last complete block, whatever follows it was torn by a
+// power loss and is cleared to empty slots and overwritten. A CSV file only
+// gets its torn last line terminated.
+//
+// The partitioned log writes the binary format to one file per day in a
+// directory (/log/2026-10-17.dat, /log/2026-10-17-1.dat when a file gets
+// larger than DATA_LOGGER_MAX_FILE_SIZE). Each file gets a sparse time index
+// with an entry every DATA_LOGGER_INDEX_INTERVAL records (.idx), and
+// manifest.txt lists the files with their first and last time so a query
+// only reads the blocks in the requested range.
+//
+// The compressed format collects the samples of each device in a series
+// encoder and writes a series record when its payload is full, when the
+// oldest sample is DATA_LOGGER_SERIES_AGE old, when the name or token of the
+// device changes and on flush(). A series is written after the samples of
+// other devices that came later, so the records of a compressed file are in
+// time order only within DATA_LOGGER_SERIES_AGE.
+class DataLogger : public MeasurementObserver {
+ public:
+  DataLogger() {}
+  DataLogger(const DataLogger&) = delete;
+  DataLogger& operator=(const DataLogger&) = delete;
+
+  // Opens the file for appending and starts the flush task
+  bool begin(FS* fs, const char* path,
+             DataLogFormat format = DataLogFormat::Csv);
+  // Starts a partitioned binary or compressed log in dir, the files are
+  // opened with the first measurement
+  bool beginPartitioned(FS* fs, const char* dir,
+                        DataLogFormat format = DataLogFormat::Binary);
+  // Writes everything pending and closes the file
+  void end();
+  // Writes and syncs through the backend, for its sync policy, preallocation
+  // and I/O counters. Set before begin(), normally the FS passed to it.
+  void setStorage(StorageIo* io) { _io = io; }
+
+  bool isOpen() const { return _open; }
+  bool isPartitioned() const { return _partitioned; }
+  DataLogFormat getFormat() const { return _format; }
+
+  // Called by the measurement list on the task that decodes the adverts
+  void onMeasurement(int slot, const MeasurementSnapshot& snapshot) override;
+
+  // Moves queued measurements into the write buffer and writes it when full
+  // or when the flush interval has passed, force writes everything now
+  // including the open series of the compressed format.
+  // Called by the flush task, or by the host program on NATIVE.
+  void process(bool force = false);
+  void flush() { process(true); }
+
+  // Passes the records of a device with from <= time <= to to the visitor,
+  // returns the number of records or -1 if the log could not be read. Only
+  // sees what has been flushed, reads the files with separate handles.
+  int query(const DeviceKey& key, uint32_t from, uint32_t to,
+            DataLogVisitor* visitor);
+
+  size_t getPending() const { return _queue.size(); }
+  size_t getBuffered() const { return _used; }
+  DataLoggerMetrics getMetrics() const;
+
+ private:
+  SpscRing<Measurement, DATA_LOGGER_QUEUE_SIZE> _queue;
+  alignas(4) uint8_t _buffer[DATA_LOGGER_BUFFER_SIZE];
+  size_t _used = 0;
+  size_t _target = DATA_LOGGER_BUFFER_SIZE;  // Fill level that ends a sector
+  uint32_t _offset = 0;                     // File size
+  uint32_t _allocated = 0;  // End of the preallocated space, UINT32_MAX if
+                            // the backend cannot preallocate
+  File _file;
+  StorageIo* _io = nullptr;
+  DataLogFormat _format = DataLogFormat::Csv;
+  BinaryLogEncoder _encoder;
+  bool _open = false;
+
+  // Compressed log, the encoders are allocated by begin
+  std::unique_ptr<SeriesEncoder[], BufferDeleter> _series;
+  std::unique_ptr<DeviceIndex<uint16_t>> _seriesIndex;
+
+  // Partitioned log
+  static constexpr int INDEX_BUFFER_SIZE = 16;
+
+  bool _partitioned = false;
+  FS* _fs = nullptr;
+  char _dir[16] = {0};
+  char _path[48] = {0};  // Current file, empty until the first measurement
+  char _day[11] = {0};   // YYYY-MM-DD of the current file
+  File _index;
+  DataLogIndexEntry _indexPending[INDEX_BUFFER_SIZE];
+  int _indexCount = 0;
+  uint32_t _sinceIndex = 0;  // Records since the last index entry
+  uint32_t _fileFirst = 0;
+  uint32_t _fileLast = 0;
+  uint32_t _dayEnd = 0;  // Local midnight after the current file's day
+  bool _dirty = false;         // Data appended since the last flush
+  uint32_t _firstPending = 0;  // millis() when the first unflushed line came
+  DataLoggerMetrics _metrics;
+
+#if !defined(NATIVE)
+  TaskHandle_t _task = nullptr;
+  SemaphoreHandle_t _lock = nullptr;  // process() runs on the task or end()
+  static void flushTask(void* parameter);
+#endif
+
+  bool isBinary() const { return _format != DataLogFormat::Csv; }
+
+  bool startSeries();
+  void addSample(const Measurement& measurement);
+  void writeSeries(uint16_t slot);
+  void writeOldSeries(bool all);
+
+  void startTask();
+  void startFile();
+  uint32_t findCommit(uint32_t size);
+  bool recover();
+  void recoverIndex();
+  void recoverOpenFiles();
+  void append(const void* data, size_t len);
+  void write(bool sync);
+  void syncFile(File& file);
+  void preallocate();
+  void alignTarget();
+
+  bool needsRotation(uint32_t time) const;
+  bool openFile(uint32_t time);
+  bool canContinue(const char* name, uint32_t time) const;
+  void closeFile();
+  void addIndex(uint32_t time);
+  void writeIndex();
+  void writeManifest(uint32_t last);
+  int queryFile(const char* name, const DeviceKey& key, uint32_t from,
+                uint32_t to, DataLogVisitor* visitor, bool* stopped);
+};
+
+extern DataLogger myDataLogger;
+
+#endif  // GATEWAY
+
+#endif  // SRC_DATA_LOGGER_HPP_
+
+// EOF
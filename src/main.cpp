@@ -28,6 +28,7 @@ SOFTWARE.
 #include <ble_gravitymon.hpp>
 #include <ble_pressuremon.hpp>
 #include <cstdio>
+#include <data_logger.hpp>
 #include <log.hpp>
 #include <utils.hpp>
 #include <measurement.hpp>
@@ -55,6 +56,95 @@ BleSender myBleSender;
 
 #elif defined(GATEWAY)
 MeasurementList myMeasurementList;
+Clock myClock;
+#if defined(ENABLE_MMC) || defined(ENABLE_SD)
+Storage mySdStorage;
+#endif
+
+// Logs changed measurements, queued so it runs on the loop task and not in
+// the BLE consumer task.
+class MeasurementLogger : public MeasurementObserver {
+ public:
+  void onMeasurement(int slot, const MeasurementSnapshot& snapshot) override {
+    const Measurement& measurement = snapshot.measurement;
+
+    switch (snapshot.getType()) {
+      case MeasurementType::Gravitymon: {
+        Log.notice("Loop: Processing Gravitymon data %d." CR, slot);
+
+        const GravityData* gd = measurement.getGravityData();
+        Log.notice(F("Main: Type=%s, Angle=%F Gravity=%F, Temp=%F, Battery=%F, "
+          "Velocity=%F, Id=%s." CR),
+        gd->getTypeAsString(), gd->getAngle(), gd->getGravity(), gd->getTempC(), gd->getBattery(), snapshot.velocity, gd->getId());
+      } break;
+
+      case MeasurementType::Pressuremon: {
+        Log.notice("Loop: Processing Pressuremon data %d." CR, slot);
+
+        const PressureData* pd = measurement.getPressureData();
+        Log.notice(
+          F("Main: Type=%s, Pressure=%F Pressure1=%F, Temp=%F, Battery=%F, "
+            "Id=%s." CR),
+          pd->getTypeAsString(), pd->getPressure(), pd->getPressure1(), pd->getTempC(), pd->getBattery(), pd->getId());
+      } break;
+
+      case MeasurementType::Tilt:
+      case MeasurementType::TiltPro: {
+        Log.notice("Loop: Processing Tilt data %d." CR, slot);
+
+        const TiltData* td = measurement.getTiltData();
+        Log.notice(F("Main: Type=%s, Gravity=%F, Temp=%F, Velocity=%F." CR),
+        td->getTypeAsString(), td->getGravity(), td->getTempC(), snapshot.velocity);
+      } break;
+
+      case MeasurementType::Chamber: {
+        Log.notice("Loop: Processing Chamber data %d." CR, slot);
+
+        const ChamberData* cd = measurement.getChamberData();
+        Log.notice(F("Main: Type=%s, Chamber=%F Beer=%F Id=%s." CR),
+        cd->getTypeAsString(), cd->getChamberTempC(), cd->getBeerTempC(), cd->getId());
+      } break;
+
+      case MeasurementType::Rapt: {
+        Log.notice("Loop: Processing Rapt data %d." CR, slot);
+
+        const RaptData* rd = measurement.getRaptData();
+        Log.notice(F("Main: Type=%s, Gravity=%F Velocity=%F (computed %F) Temp=%F Id=%s." CR),
+        rd->getTypeAsString(), rd->getGravity(), rd->getVelocity(), snapshot.velocity, rd->getTempC(), rd->getId());
+      } break;
+    }
+
+    myMeasurementList.setPushed(slot, snapshot);
+  }
+};
+
+MeasurementLogger measurementLogger;
+int logSubscription = -1;
+
+// Reads "time <epoch>" from the serial port without blocking, used to set
+// the clock when there is no network time.
+void handleSerialCommand() {
+  static char line[32];
+  static size_t len = 0;
+
+  while (Serial.available() > 0) {
+    char c = Serial.read();
+
+    if (c != '\n' && c != '\r') {
+      if (len < sizeof(line) - 1) line[len++] = c;
+      continue;
+    }
+
+    line[len] = 0;
+    len = 0;
+
+    unsigned int epoch;
+    if (sscanf(line, "time %u", &epoch) == 1 && epoch >= CLOCK_MIN_EPOCH) {
+      myClock.setEpoch(epoch);
+      Log.notice(F("Main: Clock set to %u." CR), epoch);
+    }
+  }
+}
 #endif
 
 char chip[20];
@@ -76,9 +166,36 @@ void setup() {
 
 #if defined(GATEWAY)
   Log.info(F("Running in listening mode (client)!" CR));
-  bleScanner.init();
+  myMeasurementList.begin();
+  logSubscription = myMeasurementList.subscribe(
+      &measurementLogger, MeasurementFilter::all(), ObserverDelivery::Queued);
+#if defined(ENABLE_MMC) || defined(ENABLE_SD)
+  mySdStorage.begin();
+#if defined(STORAGE_SYNC_INTERVAL)
+  mySdStorage.setSyncPolicy(SyncPolicy::Interval, STORAGE_SYNC_INTERVAL);
+#endif
+  myDataLogger.setStorage(&mySdStorage);
+#if defined(DATA_LOGGER_COMPRESSED)
+  const DataLogFormat binaryFormat = DataLogFormat::Compressed;
+#else
+  const DataLogFormat binaryFormat = DataLogFormat::Binary;
+#endif
+#if defined(DATA_LOGGER_PARTITIONED)
+  if (mySdStorage.hasCard() &&
+      myDataLogger.beginPartitioned(&mySdStorage, "/log", binaryFormat))
+#elif defined(DATA_LOGGER_BINARY)
+  if (mySdStorage.hasCard() &&
+      myDataLogger.begin(&mySdStorage, "/data.bin", binaryFormat))
+#else
+  if (mySdStorage.hasCard() && myDataLogger.begin(&mySdStorage, "/data.csv"))
+#endif
+    myMeasurementList.subscribe(&myDataLogger);
+#endif
   bleScanner.setScanTime(5);
   bleScanner.setAllowActiveScan(true);
+  bleScanner.setContinuous(true);
+  bleScanner.setAdaptiveScan(true);
+  bleScanner.init();
 #endif
 
   Log.info(F("Setup completed!" CR));
@@ -144,72 +261,63 @@ void loop() {
 #endif
 
 #if defined(GATEWAY)
-  Log.notice(F("Main: Starting BLE scan." CR));
-  bleScanner.scan();
-  delay(5000);
-
-  Log.notice(F("Main: Checking result." CR));
-
-  for (int i = 0; i < myMeasurementList.size(); i++) {
-    MeasurementEntry* entry = myMeasurementList.getMeasurementEntry(i);
-
-    switch (entry->getType()) {
-      case MeasurementType::Gravitymon: {
-        Log.notice("Loop: Processing Gravitymon data %d." CR, i);
-
-        if (entry->isUpdated()) {
-          const GravityData* gd = entry->getGravityData();
-          Log.notice(F("Main: Type=%s, Angle=%F Gravity=%F, Temp=%F, Battery=%F, "
-            "Id=%s." CR),
-          gd->getTypeAsString(), gd->getAngle(), gd->getGravity(), gd->getTempC(), gd->getBattery(), gd->getId());
-        }
-      } break;
-
-      case MeasurementType::Pressuremon: {
-        Log.notice("Loop: Processing Pressuremon data %d." CR, i);
-
-        if (entry->isUpdated()) {
-          const PressureData* pd = entry->getPressureData();
-
-          Log.notice(
-            F("Main: Type=%s, Pressure=%F Pressure1=%F, Temp=%F, Battery=%F, "
-              "Id=%s." CR),
-            pd->getTypeAsString(), pd->getPressure(), pd->getPressure1(), pd->getTempC(), pd->getBattery(), pd->getId());
-        }
-      } break;
-
-      case MeasurementType::Tilt:
-      case MeasurementType::TiltPro: {
-        Log.notice("Loop: Processing Tilt data %d." CR, i);
-
-        if (entry->isUpdated()) {
-          const TiltData* pd = entry->getTiltData();
-          Log.notice(F("Main: Type=%s, Gravity=%F, Temp=%F." CR),
-          pd->getTypeAsString(), pd->getGravity(), pd->getTempC());
-        }
-      } break;
-
-      case MeasurementType::Chamber: {
-        Log.notice("Loop: Processing Chamber data %d." CR, i);
-
-        if (entry->isUpdated()) {
-          const ChamberData* cd = entry->getChamberData();
-          Log.notice(F("Main: Type=%s, Chamber=%F Beer=%F Id=%s." CR),
-          cd->getTypeAsString(), cd->getChamberTempC(), cd->getBeerTempC(), cd->getId());
-          }
-      } break;
+  static uint32_t lastStats = 0;
+
+  bleScanner.scan();  // Only starts a scan if it has been stopped
+  handleSerialCommand();
+
+  if (!myClock.isSet() && myClock.syncFromSystemTime())
+    Log.notice(F("Main: Clock synchronized from system time." CR));
+
+  if (millis() - lastStats > 60000) {
+    lastStats = millis();
+    Log.notice(F("Main: BLE queue pushed=%u, dropped=%u, high water=%u." CR),
+               bleScanner.getQueuePushed(), bleScanner.getQueueDropped(),
+               bleScanner.getQueueHighWater());
+    Log.notice(F("Main: BLE dedup accepted=%u, duplicates=%u, foreign=%u." CR),
+               bleScanner.getDedupAccepted(), bleScanner.getDedupDuplicates(),
+               bleScanner.getForeignAdverts());
+    Log.notice(F("Main: BLE scan windows=%u, idle=%u us, max idle=%u us." CR),
+               bleScanner.getScanWindows(), bleScanner.getScanIdleTime(),
+               bleScanner.getScanMaxIdleTime());
+
+    const ScanMetrics& scan = bleScanner.getScanController().getMetrics();
+    Log.notice(F("Main: BLE scan %s (%s), interval=%d window=%d, rate=%F/s, "
+                 "duplicates=%F, devices=%u, missing=%u, changes=%u." CR),
+               ScanController::stateToString(scan.state), scan.reason,
+               scan.interval, scan.window, scan.advertRate,
+               scan.duplicateRatio, scan.activeDevices, scan.staleDevices,
+               scan.changes);
+
+    Log.notice(F("Main: Measurements=%d of %d, evicted=%u, expired=%u." CR),
+               myMeasurementList.size(), myMeasurementList.getCapacity(),
+               myMeasurementList.getEvicted(), myMeasurementList.getExpired());
+
+#if defined(ENABLE_MMC) || defined(ENABLE_SD)
+    DataLoggerMetrics sd = myDataLogger.getMetrics();
+    Log.notice(F("Main: SD records=%u, dropped=%u, high water=%u, writes=%u, "
+                 "flushes=%u, bytes=%u, flush time=%u us (max %u us), "
+                 "errors=%u." CR),
+               sd.records, sd.dropped, sd.queueHighWater, sd.writes,
+               sd.flushes, static_cast<uint32_t>(sd.bytesWritten),
+               sd.lastFlushTime, sd.maxFlushTime, sd.errors);
+
+    const StorageMetrics& io = mySdStorage.getMetrics();
+    Log.notice(F("Main: SD I/O writes=%u, unaligned=%u, syncs=%u, "
+                 "skipped=%u, write=%u us (max %u us), sync=%u us (max %u "
+                 "us), throughput=%u KB/s." CR),
+               io.writes, io.unaligned, io.syncs, io.skippedSyncs,
+               io.getAverageWriteTime(), io.maxWriteTime,
+               io.getAverageSyncTime(), io.maxSyncTime,
+               io.getThroughput() / 1024);
+#endif
+  }
 
-      case MeasurementType::Rapt: {
-        Log.notice("Loop: Processing Rapt data %d." CR, i);
+  // Wakes up as soon as the consumer task has added new data
+  if (!bleScanner.waitForUpdate(5000)) return;
 
-        if (entry->isUpdated()) {
-          const RaptData* rd = entry->getRaptData();
-          Log.notice(F("Main: Type=%s, Gravity=%F Velocity=%F Temp=%F Id=%s." CR),
-          rd->getTypeAsString(), rd->getGravity(), rd->getVelocity(), rd->getTempC(), rd->getId());
-          }
-      } break;
-    }
-  }
+  // Logs the measurements that changed since the last wakeup
+  myMeasurementList.dispatch(logSubscription);
 #endif
 }
 
@@ -29,18 +29,71 @@ SOFTWARE.
 #include <Arduino.h>
 #include <FS.h>
 
+#include <atomic>
+#include <clock.hpp>
+#include <cmath>
 #include <cstdio>
-#include <deque>
+#include <cstdlib>
+#include <log.hpp>
+#include <measurement_aggregate.hpp>
+#include <measurement_history.hpp>
+#include <measurement_index.hpp>
+#include <measurement_velocity.hpp>
 #include <memory>
 #include <sdcard_mmc.hpp>
+#include <sdcard_posix.hpp>
 #include <sdcard_sd.hpp>
+#include <type_traits>
 #include <utility>
 #include <utils.hpp>
 
+#if !defined(NATIVE)
+#include <esp_heap_caps.h>
+#endif
+
 #if defined(ENABLE_MMC) || defined(ENABLE_SD)
 extern Storage mySdStorage;
 #endif
 
+// Number of devices kept in the measurement list, can be set from the build
+// flags. When full the device that has not been updated for the longest time
+// is replaced.
+#if !defined(MEASUREMENT_CAPACITY)
+#define MEASUREMENT_CAPACITY 64
+#endif
+
+// Devices not heard from within this time (ms) are removed by expireStale()
+#if !defined(MEASUREMENT_STALE_AGE)
+#define MEASUREMENT_STALE_AGE 3600000
+#endif
+
+// Number of observers that can subscribe to the measurement list
+#if !defined(MEASUREMENT_MAX_OBSERVERS)
+#define MEASUREMENT_MAX_OBSERVERS 4
+#endif
+
+// Number of samples kept in memory per device (16 bytes each)
+#if !defined(MEASUREMENT_HISTORY_SIZE)
+#define MEASUREMENT_HISTORY_SIZE 128
+#endif
+
+struct BufferDeleter {
+  void operator()(void* p) const { free(p); }
+};
+
+// Zero filled buffer for plain data, placed in PSRAM when the board has it.
+// Returns nullptr if there is not enough memory.
+template <typename T>
+std::unique_ptr<T[], BufferDeleter> allocateBuffer(size_t count) {
+#if defined(NATIVE)
+  void* p = calloc(count, sizeof(T));
+#else
+  void* p = heap_caps_calloc(count, sizeof(T), MALLOC_CAP_SPIRAM);
+  if (p == nullptr) p = calloc(count, sizeof(T));
+#endif
+  return std::unique_ptr<T[], BufferDeleter>(static_cast<T*>(p));
+}
+
 enum MeasurementType {
   NoType = 0,
   Tilt = 1,
@@ -58,34 +111,84 @@ enum MeasurementSource {
   HttpPost = 3,
 };
 
-// Container for the measurement data
+enum TiltColor {
+  None = -1,
+  Red = 0,
+  Green = 1,
+  Black = 2,
+  Purple = 3,
+  Orange = 4,
+  Blue = 5,
+  Yellow = 6,
+  Pink = 7
+};
+
+inline const char* tiltColorToString(TiltColor color) {
+  switch (color) {
+    case TiltColor::Red:
+      return "Red";
+    case TiltColor::Green:
+      return "Green";
+    case TiltColor::Black:
+      return "Black";
+    case TiltColor::Purple:
+      return "Purple";
+    case TiltColor::Orange:
+      return "Orange";
+    case TiltColor::Blue:
+      return "Blue";
+    case TiltColor::Yellow:
+      return "Yellow";
+    case TiltColor::Pink:
+      return "Pink";
+    default:
+      return "";
+  }
+}
+
+// Size of the name and token reported by gravitymon/pressuremon (incl \0)
+constexpr size_t MEASUREMENT_NAME_LENGTH = 32;
+constexpr size_t MEASUREMENT_TOKEN_LENGTH = 32;
+constexpr size_t MEASUREMENT_CSV_LENGTH = 300;
+
+// Container for the measurement data. The data classes are plain values
+// without heap members or virtual functions, they are copied into the
+// measurement list as part of a Measurement.
 class MeasurementBaseData {
  private:
   MeasurementType _type = MeasurementType::NoType;
   MeasurementSource _source = MeasurementSource::NoSource;
-  String _id;
-  String _created;
+  uint32_t _id = 0;
+  uint32_t _created = 0;  // Epoch seconds
+  mutable char _idString[10] = {0};  // Formatted on first use
 
  public:
-  MeasurementBaseData(String id, MeasurementType type, MeasurementSource src) {
+  // The id is the chip id, the tilt color or for RAPT the last three bytes of
+  // the mac address.
+  MeasurementBaseData(uint32_t id, MeasurementType type,
+                      MeasurementSource src) {
     _id = id;
     _type = type;
     _source = src;
+    _created = myClock.now();
+  }
 
-    struct tm time;
-    getLocalTime(&time);
+  // Ends a formatted CSV line with CR LF like File::println(), returns the
+  // length of the line
+  static size_t endCsvLine(char* buffer, size_t len, int n) {
+    if (n < 0 || len < 3) return 0;
+    if (static_cast<size_t>(n) > len - 3) n = len - 3;
 
-    char buf[40];
-    snprintf(buf, sizeof(buf), "%04d-%02d-%02d %02d:%02d:%02d",
-             time.tm_year + 1900, time.tm_mon + 1, time.tm_mday, time.tm_hour,
-             time.tm_min, time.tm_sec);
-    _created = String(buf);
+    buffer[n++] = '\r';
+    buffer[n++] = '\n';
+    buffer[n] = 0;
+    return n;
   }
-  virtual ~MeasurementBaseData() {}
 
-  virtual void writeToFile(File& file) const {}
-
-  const char* getCreatedAsString() const { return _created.c_str(); }
+  uint32_t getCreated() const { return _created; }
+  char* formatCreated(char* buf, size_t len) const {
+    return Clock::format(_created, buf, len);
+  }
 
   MeasurementType getType() const { return _type; }
   const char* getTypeAsString() const {
@@ -121,19 +224,26 @@ class MeasurementBaseData {
     }
   }
 
-  const char* getId() const { return _id.c_str(); }
-};
+  uint32_t getNumericId() const { return _id; }
 
-enum TiltColor {
-  None = -1,
-  Red = 0,
-  Green = 1,
-  Black = 2,
-  Purple = 3,
-  Orange = 4,
-  Blue = 5,
-  Yellow = 6,
-  Pink = 7
+  // Tilt and Tilt Pro with the same color are the same device
+  DeviceKey getKey() const {
+    return DeviceKey(_id, _type == MeasurementType::TiltPro
+                              ? MeasurementType::Tilt
+                              : _type);
+  }
+
+  const char* getId() const {
+    if (!_idString[0]) {
+      if (_type == MeasurementType::Tilt || _type == MeasurementType::TiltPro)
+        snprintf(&_idString[0], sizeof(_idString), "%s",
+                 tiltColorToString(static_cast<TiltColor>(_id)));
+      else
+        snprintf(&_idString[0], sizeof(_idString), "%06x",
+                 static_cast<unsigned int>(_id));
+    }
+    return &_idString[0];
+  }
 };
 
 class TiltData : public MeasurementBaseData {
@@ -144,34 +254,11 @@ class TiltData : public MeasurementBaseData {
   int _rssi = 0;
   TiltColor _tiltColor;
 
-  const char* colorToString(TiltColor color) const {
-    switch (color) {
-      case TiltColor::Red:
-        return "Red";
-      case TiltColor::Green:
-        return "Green";
-      case TiltColor::Black:
-        return "Black";
-      case TiltColor::Purple:
-        return "Purple";
-      case TiltColor::Orange:
-        return "Orange";
-      case TiltColor::Blue:
-        return "Blue";
-      case TiltColor::Yellow:
-        return "Yellow";
-      case TiltColor::Pink:
-        return "Pink";
-      default:
-        return "";
-    }
-  }
-
  public:
   TiltData(MeasurementSource source, TiltColor color, float tempF,
            float gravity, int txPower, int rssi, bool pro)
       : MeasurementBaseData(
-            colorToString(color),
+            static_cast<uint32_t>(color),
             pro ? MeasurementType::TiltPro : MeasurementType::Tilt, source) {
     _tiltColor = color;
     _tempF = tempF;
@@ -179,7 +266,6 @@ class TiltData : public MeasurementBaseData {
     _txPower = txPower;
     _rssi = rssi;
   }
-  virtual ~TiltData() {}
 
   float getTempF() const { return _tempF; }
   float getTempC() const { return convertFtoC(_tempF); }
@@ -189,8 +275,8 @@ class TiltData : public MeasurementBaseData {
   int getRssi() const { return _rssi; }
   TiltColor getTiltColor() const { return _tiltColor; }
 
-  void writeToFile(File& file) const {
-    char buffer[300];
+  size_t formatCsv(char* buffer, size_t len) const {
+    char created[20];
 
     // Data parameters
     // ----------------------------------------
@@ -209,20 +295,21 @@ class TiltData : public MeasurementBaseData {
     // 12,
     // 13,
 
-    snprintf(buffer, sizeof(buffer),
-             "1,%s,%s,%s,%s,%s,"
-             "%.2f,%.4f,%d,%d,,,,",
-             getTypeAsString(), getSourceAsString(), getCreatedAsString(),
-             getId(), colorToString(_tiltColor), getTempC(), getGravity(),
-             getTxPower(), getRssi());
-    file.println(buffer);
+    int n = snprintf(buffer, len,
+                     "1,%s,%s,%s,%s,%s,"
+                     "%.2f,%.4f,%d,%d,,,,",
+                     getTypeAsString(), getSourceAsString(),
+                     formatCreated(created, sizeof(created)), getId(),
+                     tiltColorToString(_tiltColor), getTempC(), getGravity(),
+                     getTxPower(), getRssi());
+    return endCsvLine(buffer, len, n);
   }
 };
 
 class GravityData : public MeasurementBaseData {
  private:
-  String _name = "";
-  String _token = "";
+  char _name[MEASUREMENT_NAME_LENGTH] = {0};
+  char _token[MEASUREMENT_TOKEN_LENGTH] = {0};
   float _tempC = 0;
   float _gravity = 0;
   float _angle = 0;
@@ -232,12 +319,12 @@ class GravityData : public MeasurementBaseData {
   int _interval = 0;
 
  public:
-  GravityData(MeasurementSource source, String id, String name, String token,
-              float tempC, float gravity, float angle, float battery,
-              int txPower, int rssi, int interval)
+  GravityData(MeasurementSource source, uint32_t id, const char* name,
+              const char* token, float tempC, float gravity, float angle,
+              float battery, int txPower, int rssi, int interval)
       : MeasurementBaseData(id, MeasurementType::Gravitymon, source) {
-    _name = name;
-    _token = token;
+    snprintf(&_name[0], sizeof(_name), "%s", name);
+    snprintf(&_token[0], sizeof(_token), "%s", token);
     _tempC = tempC;
     _gravity = gravity;
     _angle = angle;
@@ -246,10 +333,9 @@ class GravityData : public MeasurementBaseData {
     _rssi = rssi;
     _interval = interval;
   }
-  virtual ~GravityData() {}
 
-  const char* getName() const { return _name.c_str(); }
-  const char* getToken() const { return _token.c_str(); }
+  const char* getName() const { return &_name[0]; }
+  const char* getToken() const { return &_token[0]; }
   float getTempC() const { return _tempC; }
   float getGravity() const { return _gravity; }
   float getAngle() const { return _angle; }
@@ -258,8 +344,8 @@ class GravityData : public MeasurementBaseData {
   int getRssi() const { return _rssi; }
   int getInterval() const { return _interval; }
 
-  void writeToFile(File& file) const {
-    char buffer[300];
+  size_t formatCsv(char* buffer, size_t len) const {
+    char created[20];
 
     // Data parameters
     // ----------------------------------------
@@ -278,20 +364,22 @@ class GravityData : public MeasurementBaseData {
     // 12, Rssi
     // 13, Interval
 
-    snprintf(buffer, sizeof(buffer),
-             "1,%s,%s,%s,%s,%s,%s,"
-             "%.2f,%.4f,%.4f,%.2f,%d,%d,%d",
-             getTypeAsString(), getSourceAsString(), getCreatedAsString(),
-             getId(), getName(), getToken(), getTempC(), getGravity(),
-             getAngle(), getBattery(), getTxPower(), getRssi(), getInterval());
-    file.println(buffer);
+    int n = snprintf(buffer, len,
+                     "1,%s,%s,%s,%s,%s,%s,"
+                     "%.2f,%.4f,%.4f,%.2f,%d,%d,%d",
+                     getTypeAsString(), getSourceAsString(),
+                     formatCreated(created, sizeof(created)), getId(),
+                     getName(), getToken(), getTempC(), getGravity(),
+                     getAngle(), getBattery(), getTxPower(), getRssi(),
+                     getInterval());
+    return endCsvLine(buffer, len, n);
   }
 };
 
 class PressureData : public MeasurementBaseData {
  private:
-  String _name = "";
-  String _token = "";
+  char _name[MEASUREMENT_NAME_LENGTH] = {0};
+  char _token[MEASUREMENT_TOKEN_LENGTH] = {0};
   float _tempC = 0;
   float _pressure = 0;
   float _pressure1 = 0;
@@ -301,12 +389,13 @@ class PressureData : public MeasurementBaseData {
   int _interval = 0;
 
  public:
-  PressureData(MeasurementSource source, String id, String name, String token,
-               float tempC, float pressure, float pressure1, float battery,
-               int txPower, int rssi, int interval)
+  PressureData(MeasurementSource source, uint32_t id, const char* name,
+               const char* token, float tempC, float pressure,
+               float pressure1, float battery, int txPower, int rssi,
+               int interval)
       : MeasurementBaseData(id, MeasurementType::Pressuremon, source) {
-    _name = name;
-    _token = token;
+    snprintf(&_name[0], sizeof(_name), "%s", name);
+    snprintf(&_token[0], sizeof(_token), "%s", token);
     _tempC = tempC;
     _pressure = pressure;
     _pressure1 = pressure1;
@@ -315,10 +404,9 @@ class PressureData : public MeasurementBaseData {
     _rssi = rssi;
     _interval = interval;
   }
-  virtual ~PressureData() {}
 
-  const char* getName() const { return _name.c_str(); }
-  const char* getToken() const { return _token.c_str(); }
+  const char* getName() const { return &_name[0]; }
+  const char* getToken() const { return &_token[0]; }
   float getTempC() const { return _tempC; }
   float getPressure() const { return _pressure; }
   float getPressure1() const { return _pressure1; }
@@ -327,8 +415,8 @@ class PressureData : public MeasurementBaseData {
   int getRssi() const { return _rssi; }
   int getInterval() const { return _interval; }
 
-  void writeToFile(File& file) const {
-    char buffer[300];
+  size_t formatCsv(char* buffer, size_t len) const {
+    char created[20];
 
     // Data parameters
     // ----------------------------------------
@@ -347,14 +435,15 @@ class PressureData : public MeasurementBaseData {
     // 12, Rssi
     // 13, Interval
 
-    snprintf(buffer, sizeof(buffer),
-             "1,%s,%s,%s,%s,%s,%s,"
-             "%.2f,%.4f,%.4f,%.2f,%d,%d,%d",
-             getTypeAsString(), getSourceAsString(), getCreatedAsString(),
-             getId(), getName(), getToken(), getTempC(), getPressure(),
-             getPressure1(), getBattery(), getTxPower(), getRssi(),
-             getInterval());
-    file.println(buffer);
+    int n = snprintf(buffer, len,
+                     "1,%s,%s,%s,%s,%s,%s,"
+                     "%.2f,%.4f,%.4f,%.2f,%d,%d,%d",
+                     getTypeAsString(), getSourceAsString(),
+                     formatCreated(created, sizeof(created)), getId(),
+                     getName(), getToken(), getTempC(), getPressure(),
+                     getPressure1(), getBattery(), getTxPower(), getRssi(),
+                     getInterval());
+    return endCsvLine(buffer, len, n);
   }
 };
 
@@ -365,21 +454,20 @@ class ChamberData : public MeasurementBaseData {
   int _rssi = 0;
 
  public:
-  ChamberData(MeasurementSource source, String id, float chamberTempC,
+  ChamberData(MeasurementSource source, uint32_t id, float chamberTempC,
               float beerTempC, int rssi)
       : MeasurementBaseData(id, MeasurementType::Chamber, source) {
     _chamberTempC = chamberTempC;
     _beerTempC = beerTempC;
     _rssi = rssi;
   }
-  virtual ~ChamberData() {}
 
   float getChamberTempC() const { return _chamberTempC; }
   float getBeerTempC() const { return _beerTempC; }
   int getRssi() const { return _rssi; }
 
-  void writeToFile(File& file) const {
-    char buffer[300];
+  size_t formatCsv(char* buffer, size_t len) const {
+    char created[20];
 
     // Data parameters
     // ----------------------------------------
@@ -398,12 +486,13 @@ class ChamberData : public MeasurementBaseData {
     // 12,
     // 13,
 
-    snprintf(buffer, sizeof(buffer),
-             "1,%s,%s,%s,%s,"
-             "%.2f,%.2f,%d,,,,,,",
-             getTypeAsString(), getSourceAsString(), getCreatedAsString(),
-             getId(), getChamberTempC(), getBeerTempC(), getRssi());
-    file.println(buffer);
+    int n = snprintf(buffer, len,
+                     "1,%s,%s,%s,%s,"
+                     "%.2f,%.2f,%d,,,,,,",
+                     getTypeAsString(), getSourceAsString(),
+                     formatCreated(created, sizeof(created)), getId(),
+                     getChamberTempC(), getBeerTempC(), getRssi());
+    return endCsvLine(buffer, len, n);
   }
 };
 
@@ -420,7 +509,7 @@ class RaptData : public MeasurementBaseData {
  public:
   // Note! For RAPT the last part of the MAC adress is used as ID since the
   // payload does not contain that.
-  RaptData(MeasurementSource source, String id, float tempC, float gravity,
+  RaptData(MeasurementSource source, uint32_t id, float tempC, float gravity,
            float velocity, float angle, float battery, int txPower, int rssi)
       : MeasurementBaseData(id, MeasurementType::Rapt, source) {
     _tempC = tempC;
@@ -431,7 +520,6 @@ class RaptData : public MeasurementBaseData {
     _txPower = txPower;
     _rssi = rssi;
   }
-  virtual ~RaptData() {}
 
   float getTempC() const { return _tempC; }
   float getGravity() const { return _gravity; }
@@ -441,8 +529,8 @@ class RaptData : public MeasurementBaseData {
   int getTxPower() const { return _txPower; }
   int getRssi() const { return _rssi; }
 
-  void writeToFile(File& file) const {
-    char buffer[300];
+  size_t formatCsv(char* buffer, size_t len) const {
+    char created[20];
 
     // Data parameters
     // ----------------------------------------
@@ -458,144 +546,729 @@ class RaptData : public MeasurementBaseData {
     // 9, Tx Power
     // 10, Rssi
 
-    snprintf(buffer, sizeof(buffer),
-             "1,%s,%s,%s,%s,"
-             "%.2f,%.4f,%.4f,%.2f,%d,%d,,,",
-             getTypeAsString(), getSourceAsString(), getCreatedAsString(),
-             getId(), getTempC(), getGravity(),
-             getAngle(), getBattery(), getTxPower(), getRssi());
-    file.println(buffer);
+    int n = snprintf(buffer, len,
+                     "1,%s,%s,%s,%s,"
+                     "%.2f,%.4f,%.4f,%.2f,%d,%d,,,",
+                     getTypeAsString(), getSourceAsString(),
+                     formatCreated(created, sizeof(created)), getId(),
+                     getTempC(), getGravity(), getAngle(), getBattery(),
+                     getTxPower(), getRssi());
+    return endCsvLine(buffer, len, n);
   }
 };
 
-// Base class for measurement data keeping track of last updated and pushed
-class MeasurementEntry {
+// One measurement of any type stored in place, the type of the base data
+// tells which member is valid. Copying is a plain memory copy so a decoded
+// advert can be stored without touching the heap.
+class Measurement {
  private:
-  std::unique_ptr<MeasurementBaseData> _measurement;
-  bool _updated = false;
-  struct tm _timeinfoUpdated;
-  uint32_t _timeUpdated = 0;
-  uint32_t _timePushed = 0;
-  String _id = "";
+  union Data {
+    MeasurementBaseData base;
+    TiltData tilt;
+    GravityData gravity;
+    PressureData pressure;
+    ChamberData chamber;
+    RaptData rapt;
+
+    Data() : base(0, MeasurementType::NoType, MeasurementSource::NoSource) {}
+    explicit Data(const TiltData& d) : tilt(d) {}
+    explicit Data(const GravityData& d) : gravity(d) {}
+    explicit Data(const PressureData& d) : pressure(d) {}
+    explicit Data(const ChamberData& d) : chamber(d) {}
+    explicit Data(const RaptData& d) : rapt(d) {}
+  };
+
+  MeasurementType _type = MeasurementType::NoType;
+  Data _data;
 
  public:
-  explicit MeasurementEntry(String id) { _id = id; }
-  ~MeasurementEntry() {}
+  Measurement() {}
+  Measurement(const TiltData& d) : _type(d.getType()), _data(d) {}  // NOLINT
+  Measurement(const GravityData& d)  // NOLINT
+      : _type(d.getType()), _data(d) {}
+  Measurement(const PressureData& d)  // NOLINT
+      : _type(d.getType()), _data(d) {}
+  Measurement(const ChamberData& d)  // NOLINT
+      : _type(d.getType()), _data(d) {}
+  Measurement(const RaptData& d) : _type(d.getType()), _data(d) {}  // NOLINT
+
+  MeasurementType getType() const { return _type; }
 
-  const MeasurementBaseData* getData() const { return _measurement.get(); }
-  const TiltData* getTiltData() {
-    return static_cast<TiltData*>(_measurement.get());
+  const MeasurementBaseData* getData() const {
+    switch (_type) {
+      case MeasurementType::Tilt:
+      case MeasurementType::TiltPro:
+        return &_data.tilt;
+      case MeasurementType::Gravitymon:
+        return &_data.gravity;
+      case MeasurementType::Pressuremon:
+        return &_data.pressure;
+      case MeasurementType::Chamber:
+        return &_data.chamber;
+      case MeasurementType::Rapt:
+        return &_data.rapt;
+      default:
+        return nullptr;
+    }
   }
-  const GravityData* getGravityData() const {
-    return static_cast<GravityData*>(_measurement.get());
+
+  const TiltData* getTiltData() const { return &_data.tilt; }
+  const GravityData* getGravityData() const { return &_data.gravity; }
+  const PressureData* getPressureData() const { return &_data.pressure; }
+  const ChamberData* getChamberData() const { return &_data.chamber; }
+  const RaptData* getRaptData() const { return &_data.rapt; }
+
+  // Formats the v1 CSV line into buffer (MEASUREMENT_CSV_LENGTH bytes)
+  size_t formatCsv(char* buffer, size_t len) const {
+    switch (_type) {
+      case MeasurementType::Tilt:
+      case MeasurementType::TiltPro:
+        return _data.tilt.formatCsv(buffer, len);
+      case MeasurementType::Gravitymon:
+        return _data.gravity.formatCsv(buffer, len);
+      case MeasurementType::Pressuremon:
+        return _data.pressure.formatCsv(buffer, len);
+      case MeasurementType::Chamber:
+        return _data.chamber.formatCsv(buffer, len);
+      case MeasurementType::Rapt:
+        return _data.rapt.formatCsv(buffer, len);
+      default:
+        return 0;
+    }
   }
-  const RaptData* getRaptData() const {
-    return static_cast<RaptData*>(_measurement.get());
+
+  void writeToFile(File& file) const {
+    char buffer[MEASUREMENT_CSV_LENGTH];
+
+    file.write(reinterpret_cast<const uint8_t*>(buffer),
+               formatCsv(buffer, sizeof(buffer)));
   }
-  const PressureData* getPressureData() const {
-    return static_cast<PressureData*>(_measurement.get());
+
+  HistorySample toSample() const {
+    HistorySample sample = {};
+
+    switch (_type) {
+      case MeasurementType::Tilt:
+      case MeasurementType::TiltPro:
+        sample.temp = lroundf(_data.tilt.getTempC() * 1000);
+        sample.value = lroundf(_data.tilt.getGravity() * 10000);
+        break;
+      case MeasurementType::Gravitymon:
+        sample.temp = lroundf(_data.gravity.getTempC() * 1000);
+        sample.value = lroundf(_data.gravity.getGravity() * 10000);
+        sample.value1 = lroundf(_data.gravity.getAngle() * 100);
+        sample.battery = lroundf(_data.gravity.getBattery() * 1000);
+        break;
+      case MeasurementType::Pressuremon:
+        sample.temp = lroundf(_data.pressure.getTempC() * 1000);
+        sample.value = lroundf(_data.pressure.getPressure() * 100);
+        sample.value1 = lroundf(_data.pressure.getPressure1() * 100);
+        sample.battery = lroundf(_data.pressure.getBattery() * 1000);
+        break;
+      case MeasurementType::Chamber:
+        sample.temp = lroundf(_data.chamber.getChamberTempC() * 1000);
+        sample.value = lroundf(_data.chamber.getBeerTempC() * 1000);
+        break;
+      case MeasurementType::Rapt:
+        sample.temp = lroundf(_data.rapt.getTempC() * 1000);
+        sample.value = lroundf(_data.rapt.getGravity() * 10000);
+        sample.value1 = lroundf(_data.rapt.getAngle() * 100);
+        sample.battery = lroundf(_data.rapt.getBattery() * 1000);
+        break;
+      default:
+        break;
+    }
+
+    const MeasurementBaseData* data = getData();
+    if (data != nullptr) sample.time = data->getCreated();
+    return sample;
   }
-  const ChamberData* getChamberData() const {
-    return static_cast<ChamberData*>(_measurement.get());
+};
+
+static_assert(std::is_trivially_copyable<Measurement>::value,
+              "Measurement must be copyable without constructors");
+
+// Consistent copy of an entry taken with MeasurementList::getSnapshot()
+struct MeasurementSnapshot {
+  DeviceKey key;
+  Measurement measurement;
+  uint32_t sequence = 0;
+  uint32_t timeUpdated = 0;   // millis()
+  uint32_t epochUpdated = 0;  // Clock
+  bool updated = false;       // Changed since setPushed()
+  bool hasVelocity = false;
+  float velocity = 0;
+
+  MeasurementType getType() const { return measurement.getType(); }
+  const MeasurementBaseData* getData() const { return measurement.getData(); }
+  const char* getId() const {
+    const MeasurementBaseData* data = measurement.getData();
+    return data != nullptr ? data->getId() : "";
+  }
+};
+
+// Receives changed measurements, see MeasurementList::subscribe()
+class MeasurementObserver {
+ public:
+  virtual ~MeasurementObserver() {}
+  virtual void onMeasurement(int slot, const MeasurementSnapshot& snapshot) = 0;
+};
+
+// Selects the devices an observer is interested in
+struct MeasurementFilter {
+  MeasurementType type = MeasurementType::NoType;  // NoType for all
+  bool matchKey = false;
+  DeviceKey key;
+
+  static MeasurementFilter all() { return MeasurementFilter(); }
+
+  // Tilt also matches Tilt Pro
+  static MeasurementFilter byType(MeasurementType type) {
+    MeasurementFilter filter;
+    filter.type = type == MeasurementType::TiltPro ? MeasurementType::Tilt
+                                                   : type;
+    return filter;
+  }
+
+  static MeasurementFilter byDevice(const DeviceKey& key) {
+    MeasurementFilter filter;
+    filter.matchKey = true;
+    filter.key = key;
+    return filter;
+  }
+
+  bool matches(const DeviceKey& k) const {
+    if (matchKey) return k == key;
+    return type == MeasurementType::NoType || k.tag == type;
+  }
+};
+
+enum class ObserverDelivery {
+  Direct,  // Called on the writer task as part of updateData()
+  Queued   // Collected until the observer's task calls dispatch()
+};
+
+// Base class for measurement data keeping track of last updated and pushed.
+//
+// Entries are written by one task (the BLE consumer) and read by others. Each
+// entry has a sequence number that is odd while the writer changes it, a
+// reader copies the entry and retries if the sequence changed meanwhile
+// (seqlock). The writer never waits for a reader.
+class MeasurementEntry {
+ private:
+  std::atomic<uint32_t> _sequence;
+  std::atomic<uint32_t> _pushed;  // Sequence when last pushed, set by readers
+  std::atomic<uint32_t> _timePushed;
+  Measurement _measurement;
+  uint32_t _epochUpdated = 0;
+  uint32_t _timeUpdated = 0;
+  DeviceKey _key;
+  HistoryRing _history;
+  AggregateSet _aggregates;
+  GravityVelocity _velocity;
+
+  // Links in the least recently updated list (or the free list), owned by
+  // MeasurementList
+  uint16_t _lruPrev = 0;
+  uint16_t _lruNext = 0;
+
+  friend class MeasurementList;
+
+  void beginWrite() {
+    _sequence.store(_sequence.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
   }
 
-  void setMeasurement(std::unique_ptr<MeasurementBaseData> measurement) {
-    _measurement = std::move(measurement);
-    setUpdated();
+  void endWrite() {
+    _sequence.store(_sequence.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_release);
   }
 
-  MeasurementType getType() const {
-    if (_measurement != nullptr) return _measurement->getType();
-    return MeasurementType::NoType;
+  void reset(const DeviceKey& key) {
+    _measurement = Measurement();
+    _timeUpdated = 0;
+    _epochUpdated = 0;
+    _key = key;
+    _history.clear();
+    _aggregates.clear();
+    _velocity.clear();
   }
 
-  bool isUpdated() const { return _updated; }
-  const String& getId() const { return _id; }
+  void setMeasurement(const Measurement& measurement) {
+    HistorySample sample = measurement.toSample();
 
-  void setUpdated() {
-    _updated = true;
+    _measurement = measurement;
+    _history.push(sample);
+    _aggregates.add(sample);
+    if (isHydrometer()) _velocity.add(sample.time, sample.value);
     _timeUpdated = millis();
-    getLocalTime(&_timeinfoUpdated);
+    _epochUpdated = myClock.now();
+  }
+
+  // Copies the entry with f, returns false if the writer changed it meanwhile
+  template <typename F>
+  bool tryRead(F f) const {
+    uint32_t sequence = _sequence.load(std::memory_order_acquire);
+
+    if (sequence & 1) return false;
+
+    f(sequence);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return _sequence.load(std::memory_order_relaxed) == sequence;
   }
 
-  void setPushed() {
-    _updated = false;
-    _timePushed = millis();
+ public:
+  MeasurementEntry() : _sequence(0), _pushed(0), _timePushed(0) {}
+
+  // The accessors below read the entry without synchronization, they are
+  // only safe on the writer task. Other tasks use the snapshots.
+  const MeasurementBaseData* getData() const {
+    return _measurement.getData();
+  }
+  const TiltData* getTiltData() const { return _measurement.getTiltData(); }
+  const GravityData* getGravityData() const {
+    return _measurement.getGravityData();
+  }
+  const RaptData* getRaptData() const { return _measurement.getRaptData(); }
+  const PressureData* getPressureData() const {
+    return _measurement.getPressureData();
+  }
+  const ChamberData* getChamberData() const {
+    return _measurement.getChamberData();
   }
 
+  bool isHydrometer() const {
+    switch (getType()) {
+      case MeasurementType::Tilt:
+      case MeasurementType::TiltPro:
+      case MeasurementType::Gravitymon:
+      case MeasurementType::Rapt:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  // Computed from the gravity readings, SG points per 24 hours
+  bool hasVelocity() const { return _velocity.isValid(); }
+  float getVelocity() const { return _velocity.getVelocity(); }
+
+  const HistoryRing& getHistory() const { return _history; }
+  const AggregateSet& getAggregates() const { return _aggregates; }
+
+  MeasurementType getType() const { return _measurement.getType(); }
+  const DeviceKey& getKey() const { return _key; }
+  const char* getId() const {
+    const MeasurementBaseData* data = _measurement.getData();
+    return data != nullptr ? data->getId() : "";
+  }
+
+  uint32_t getTimeUpdated() const { return _timeUpdated; }
   uint32_t getUpdateAge() const { return (millis() - _timeUpdated) / 1000; }
-  uint32_t getPushAge() const { return (millis() - _timePushed) / 1000; }
-  const struct tm* getTimeinfoUpdated() const { return &_timeinfoUpdated; }
+  uint32_t getEpochUpdated() const { return _epochUpdated; }
+
+  // Safe from any task
+  bool isUpdated() const {
+    return _sequence.load(std::memory_order_acquire) !=
+           _pushed.load(std::memory_order_relaxed);
+  }
+  uint32_t getPushAge() const {
+    return (millis() - _timePushed.load(std::memory_order_relaxed)) / 1000;
+  }
 };
 
-// List of data measurements
+// List of data measurements. The entries are allocated once and never move,
+// so a slot can be read by index from any task. A hash index finds the slot
+// of a device and a doubly linked list threaded through the entries keeps
+// them in the order they were updated (head is the least recently updated).
+// Slots of removed devices are kept on a free list for reuse.
+//
+// updateData() must always be called from the same task, the index and the
+// lists are only used by that task.
 class MeasurementList {
  private:
-  std::deque<std::unique_ptr<MeasurementEntry>> _list;
-  const int MAX_ENTRIES = 20;
+  static constexpr uint16_t NO_ENTRY = 0xffff;
+  static constexpr int READ_RETRIES = 4;  // Before giving the writer time
+
+  std::unique_ptr<MeasurementEntry[]> _entries;
+  std::unique_ptr<HistorySample[], BufferDeleter> _history;
+  std::unique_ptr<AggregateBucket[], BufferDeleter> _aggregates;
+  DeviceIndex<uint16_t> _index;
+  int _capacity;
+  int _historySize;
+  std::atomic<int> _slots;  // Slots handed out so far
+  std::atomic<int> _size;   // Devices in the list
+  uint16_t _lruHead = NO_ENTRY;
+  uint16_t _lruTail = NO_ENTRY;
+  uint16_t _freeHead = NO_ENTRY;
+  uint32_t _evicted = 0;
+  uint32_t _expired = 0;
+
+  // A queued observer has one pending bit per slot, set by the writer and
+  // taken by dispatch(), so no change is lost and each observer keeps its
+  // own bookkeeping.
+  struct Subscription {
+    MeasurementObserver* observer = nullptr;
+    MeasurementFilter filter;
+    ObserverDelivery delivery = ObserverDelivery::Direct;
+    std::unique_ptr<std::atomic<uint32_t>[]> pending;
+    uint32_t delivered = 0;
+  };
+
+  Subscription _subscriptions[MEASUREMENT_MAX_OBSERVERS];
+  int _subscriptionCount = 0;
+
+  void notifyObservers(uint16_t i) {
+    const DeviceKey& key = _entries[i].getKey();
+
+    for (int s = 0; s < _subscriptionCount; s++) {
+      Subscription& sub = _subscriptions[s];
+
+      if (!sub.filter.matches(key)) continue;
+
+      if (sub.delivery == ObserverDelivery::Direct) {
+        MeasurementSnapshot snapshot;
+
+        if (getSnapshot(i, &snapshot)) {
+          sub.observer->onMeasurement(i, snapshot);
+          sub.delivered++;
+        }
+      } else {
+        sub.pending[i / 32].fetch_or(1u << (i % 32),
+                                     std::memory_order_release);
+      }
+    }
+  }
+
+  void lruUnlink(uint16_t i) {
+    MeasurementEntry& entry = _entries[i];
+
+    if (entry._lruPrev != NO_ENTRY)
+      _entries[entry._lruPrev]._lruNext = entry._lruNext;
+    else
+      _lruHead = entry._lruNext;
+
+    if (entry._lruNext != NO_ENTRY)
+      _entries[entry._lruNext]._lruPrev = entry._lruPrev;
+    else
+      _lruTail = entry._lruPrev;
+  }
+
+  void lruAppend(uint16_t i) {
+    MeasurementEntry& entry = _entries[i];
+
+    entry._lruPrev = _lruTail;
+    entry._lruNext = NO_ENTRY;
+
+    if (_lruTail != NO_ENTRY)
+      _entries[_lruTail]._lruNext = i;
+    else
+      _lruHead = i;
+
+    _lruTail = i;
+  }
+
+  void remove(uint16_t i) {
+    MeasurementEntry& entry = _entries[i];
+
+    lruUnlink(i);
+    _index.erase(entry.getKey());
+
+    entry.beginWrite();
+    entry.reset(DeviceKey());
+    entry.endWrite();
+
+    entry._lruNext = _freeHead;
+    _freeHead = i;
+    _size.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  // Retries a snapshot until the writer leaves the entry alone
+  template <typename F>
+  void read(const MeasurementEntry& entry, F f) const {
+    for (int retry = 0; !entry.tryRead(f); retry++) {
+      if (retry >= READ_RETRIES) delay(1);  // Writer may be preempted
+    }
+  }
 
  public:
-  MeasurementList() {}
+  explicit MeasurementList(int capacity = MEASUREMENT_CAPACITY,
+                           int historySize = MEASUREMENT_HISTORY_SIZE)
+      : _entries(new MeasurementEntry[capacity]),
+        _index(capacity),
+        _capacity(capacity),
+        _historySize(historySize),
+        _slots(0),
+        _size(0) {}
   ~MeasurementList() { clear(); }
 
-  void updateData(std::unique_ptr<MeasurementBaseData>& data) {
-    if (data.get() == nullptr) {
+  // Allocates the history and aggregate buffers, called from setup() before
+  // the first update. Not done by the constructor since PSRAM is only added
+  // to the heap after the global objects are created. Without memory for
+  // them the entries keep no history, returns false in that case.
+  bool begin() {
+    uint32_t historyBytes = _capacity * _historySize * sizeof(HistorySample);
+    uint32_t aggregateBytes =
+        _capacity * AGGREGATE_ROWS * sizeof(AggregateBucket);
+
+    if (!_history) {
+      _history = allocateBuffer<HistorySample>(_capacity * _historySize);
+      if (!_history)
+        Log.error(F("Meas: Failed to allocate %u bytes for the history." CR),
+                  historyBytes);
+    }
+    if (!_aggregates) {
+      _aggregates = allocateBuffer<AggregateBucket>(_capacity * AGGREGATE_ROWS);
+      if (!_aggregates)
+        Log.error(
+            F("Meas: Failed to allocate %u bytes for the aggregates." CR),
+            aggregateBytes);
+    }
+
+    for (int i = 0; i < _capacity; i++) {
+      if (_history)
+        _entries[i]._history.attach(&_history[i * _historySize], _historySize);
+      if (_aggregates)
+        _entries[i]._aggregates.attach(&_aggregates[i * AGGREGATE_ROWS]);
+    }
+
+    return _history && _aggregates;
+  }
+
+  void updateData(const Measurement& measurement) {
+    const MeasurementBaseData* data = measurement.getData();
+
+    if (data == nullptr) {
       return;
     }
 
-    if (size() > MAX_ENTRIES)  // If list if full, remove the oldest entry
-      _list.pop_front();
+    expireStale();
 
-    int i = findMeasurementById(data->getId());
+    DeviceKey key = data->getKey();
+    uint16_t* slot = _index.find(key);
+    uint16_t i;
 
-#if defined(ENABLE_MMC) || defined(ENABLE_SD)
-    if (mySdStorage.hasCard()) {
-      File file = mySdStorage.open("/data.csv", FILE_APPEND, true);
-      if (file) {
-        data->writeToFile(file);
-        file.close();
+    if (slot != nullptr) {
+      i = *slot;
+      lruUnlink(i);
+      _entries[i].beginWrite();
+    } else {
+      if (_freeHead != NO_ENTRY) {
+        i = _freeHead;
+        _freeHead = _entries[i]._lruNext;
+        _size.fetch_add(1, std::memory_order_relaxed);
+      } else if (_slots.load(std::memory_order_relaxed) < _capacity) {
+        i = _slots.load(std::memory_order_relaxed);
+        _size.fetch_add(1, std::memory_order_relaxed);
       } else {
-        Log.error(F("SD  : Failed to open data.csv for writing." CR));
+        // Reuse the entry of the device that has been silent the longest
+        i = _lruHead;
+        lruUnlink(i);
+        Log.notice(F("Meas: List full, replacing %s with %s." CR),
+                   _entries[i].getId(), data->getId());
+        _index.erase(_entries[i].getKey());
+        _evicted++;
       }
+
+      _entries[i].beginWrite();
+      _entries[i].reset(key);
+      _index.insert(key, i);
     }
-#endif
 
-    if (i == -1) {
-      std::unique_ptr<MeasurementEntry> entry;
+    _entries[i].setMeasurement(measurement);
+    _entries[i].endWrite();
+    lruAppend(i);
 
-      entry.reset(new MeasurementEntry(data->getId()));
-      entry->setMeasurement(std::move(data));
-      _list.push_back(std::move(entry));
-    } else {
-      MeasurementEntry* entry = getMeasurementEntry(i);
+    // Publish a new slot after the entry is complete
+    if (i == _slots.load(std::memory_order_relaxed))
+      _slots.store(i + 1, std::memory_order_release);
+
+    notifyObservers(i);
+  }
 
-      if (entry != nullptr) entry->setMeasurement(std::move(data));
+  // Registers an observer for changed measurements, returns the
+  // subscription id or -1 if there is no room. Subscribe before the scanner
+  // is started, the list of observers is not synchronized.
+  int subscribe(MeasurementObserver* observer,
+                const MeasurementFilter& filter = MeasurementFilter::all(),
+                ObserverDelivery delivery = ObserverDelivery::Direct) {
+    if (observer == nullptr || _subscriptionCount >= MEASUREMENT_MAX_OBSERVERS)
+      return -1;
+
+    Subscription& sub = _subscriptions[_subscriptionCount];
+    sub.observer = observer;
+    sub.filter = filter;
+    sub.delivery = delivery;
+    sub.delivered = 0;
+
+    if (delivery == ObserverDelivery::Queued) {
+      int words = (_capacity + 31) / 32;
+
+      sub.pending.reset(new std::atomic<uint32_t>[words]);
+      for (int w = 0; w < words; w++)
+        sub.pending[w].store(0, std::memory_order_relaxed);
     }
+
+    return _subscriptionCount++;
   }
 
-  MeasurementType getMeasurementType(int index) {
-    if (index < 0 || index >= size()) return MeasurementType::NoType;
-    return getMeasurementEntry(index)->getType();
+  bool hasPending(int subscription) const {
+    if (subscription < 0 || subscription >= _subscriptionCount ||
+        !_subscriptions[subscription].pending)
+      return false;
+
+    for (int w = 0; w < (_capacity + 31) / 32; w++) {
+      if (_subscriptions[subscription].pending[w].load(
+              std::memory_order_relaxed))
+        return true;
+    }
+    return false;
   }
 
-  int findMeasurementById(const String id) const {
-    int i = 0;
-    for (const std::unique_ptr<MeasurementEntry>& item : _list) {
-      if (id == item->getId()) {
-        return i;
+  // Delivers the changes collected for a queued observer, called from the
+  // observer's task. Returns the number of measurements delivered.
+  int dispatch(int subscription) {
+    if (subscription < 0 || subscription >= _subscriptionCount ||
+        !_subscriptions[subscription].pending)
+      return 0;
+
+    Subscription& sub = _subscriptions[subscription];
+    MeasurementSnapshot snapshot;
+    int delivered = 0;
+
+    for (int w = 0; w < (_capacity + 31) / 32; w++) {
+      uint32_t bits = sub.pending[w].exchange(0, std::memory_order_acquire);
+
+      while (bits) {
+        int i = w * 32 + __builtin_ctz(bits);
+        bits &= bits - 1;
+
+        // The slot can have been reused by another device meanwhile
+        if (getSnapshot(i, &snapshot) && sub.filter.matches(snapshot.key)) {
+          sub.observer->onMeasurement(i, snapshot);
+          delivered++;
+        }
       }
-      i++;
     }
 
-    return -1;
+    sub.delivered += delivered;
+    return delivered;
+  }
+
+  uint32_t getDelivered(int subscription) const {
+    if (subscription < 0 || subscription >= _subscriptionCount) return 0;
+    return _subscriptions[subscription].delivered;
   }
 
+  // Removes devices that have not been updated within max age (ms), returns
+  // the number of removed entries. Called by updateData(), checking the
+  // oldest entry is all it costs when nothing has expired.
+  int expireStale(uint32_t maxAge = MEASUREMENT_STALE_AGE) {
+    uint32_t now = millis();
+    int removed = 0;
+
+    while (_lruHead != NO_ENTRY &&
+           now - _entries[_lruHead].getTimeUpdated() > maxAge) {
+      remove(_lruHead);
+      removed++;
+    }
+
+    _expired += removed;
+    return removed;
+  }
+
+  // Copies the entry in a slot, returns false if the slot is not in use.
+  // Safe from any task.
+  bool getSnapshot(int slot, MeasurementSnapshot* snapshot) const {
+    if (slot < 0 || slot >= getSlots()) return false;
+
+    const MeasurementEntry& entry = _entries[slot];
+
+    read(entry, [&](uint32_t sequence) {
+      snapshot->key = entry._key;
+      snapshot->measurement = entry._measurement;
+      snapshot->sequence = sequence;
+      snapshot->timeUpdated = entry._timeUpdated;
+      snapshot->epochUpdated = entry._epochUpdated;
+      snapshot->hasVelocity = entry._velocity.isValid();
+      snapshot->velocity = entry._velocity.getVelocity();
+    });
+
+    snapshot->updated =
+        snapshot->sequence != entry._pushed.load(std::memory_order_relaxed);
+    return snapshot->getType() != MeasurementType::NoType;
+  }
+
+  // Copies the history samples with from <= time < to of the device in the
+  // snapshot, oldest first. Returns the number of samples copied, 0 if the
+  // slot now holds another device. Safe from any task.
+  int getHistory(int slot, const MeasurementSnapshot& snapshot, uint32_t from,
+                 uint32_t to, HistorySample* samples, int max) const {
+    if (slot < 0 || slot >= getSlots()) return 0;
+
+    const MeasurementEntry& entry = _entries[slot];
+    int count = 0;
+
+    read(entry, [&](uint32_t sequence) {
+      count = 0;
+      if (entry._key != snapshot.key) return;
+
+      for (const HistorySample& sample : entry._history.range(from, to)) {
+        if (count >= max) break;
+        samples[count++] = sample;
+      }
+    });
+
+    return count;
+  }
+
+  // Marks the version in the snapshot as handled, a newer update still shows
+  // as updated. Safe from any task.
+  void setPushed(int slot, const MeasurementSnapshot& snapshot) {
+    if (slot < 0 || slot >= getSlots()) return;
+
+    _entries[slot]._pushed.store(snapshot.sequence, std::memory_order_relaxed);
+    _entries[slot]._timePushed.store(millis(), std::memory_order_relaxed);
+  }
+
+  MeasurementType getMeasurementType(int index) {
+    if (index < 0 || index >= getSlots()) return MeasurementType::NoType;
+    return getMeasurementEntry(index)->getType();
+  }
+
+  // Writer task only
+  MeasurementEntry* findMeasurement(const DeviceKey& key) const {
+    uint16_t* slot = _index.find(key);
+    return slot != nullptr ? &_entries[*slot] : nullptr;
+  }
+
+  // Writer task only, use getSnapshot() from other tasks
   MeasurementEntry* getMeasurementEntry(int index) {
-    return _list[index].get();
+    return &_entries[index];
+  }
+
+  // Writer task only
+  void clear() {
+    for (int i = 0; i < getSlots(); i++) {
+      _entries[i].beginWrite();
+      _entries[i].reset(DeviceKey());
+      _entries[i].endWrite();
+    }
+
+    _index.clear();
+    _slots.store(0, std::memory_order_release);
+    _size.store(0, std::memory_order_relaxed);
+    _lruHead = _lruTail = _freeHead = NO_ENTRY;
   }
 
-  void clear() { _list.clear(); }
-  int size() const { return _list.size(); }
+  // Number of devices, they can be spread over getSlots() slots
+  int size() const { return _size.load(std::memory_order_relaxed); }
+  int getSlots() const { return _slots.load(std::memory_order_acquire); }
+  int getCapacity() const { return _capacity; }
+
+  uint32_t getEvicted() const { return _evicted; }
+  uint32_t getExpired() const { return _expired; }
 };
 
 extern MeasurementList myMeasurementList;
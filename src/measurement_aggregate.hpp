@@ -0,0 +1,175 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_MEASUREMENT_AGGREGATE_HPP_
+#define SRC_MEASUREMENT_AGGREGATE_HPP_
+
+#if defined(GATEWAY)
+
+#include <measurement_history.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Round robin aggregates per device at a few fixed resolutions, so a chart
+// of a whole fermentation can be served from memory. Each level is an array
+// of buckets, a sample is added to the bucket covering its time at every
+// level and a bucket is reused when its time slot comes around again.
+//
+// Layout, all values little endian as stored in memory. A device has the
+// levels below one after the other (AGGREGATE_ROWS buckets in total), bucket
+// n of a level covers the slot where (start / seconds) % rows == n.
+//
+//   level  seconds  rows  span
+//   -------------------------------
+//   0      60       60    1 hour
+//   1      900      96    1 day
+//   2      3600     72    3 days
+//   3      86400    60    2 months
+//
+//   AggregateBucket (48 bytes)
+//   offset  size  field
+//   0       4     start, epoch seconds of the slot, 0 if never used
+//   4       4     count, number of samples
+//   8       8     temp sum (int64)
+//   16      8     value sum (int64)
+//   24      12    temp: min, max, last (int32, see HistorySample)
+//   36      12    value: min, max, last (int32, see HistorySample)
+//
+// The mean is sum / count. A jittery beacon gets past the dedup about once
+// a second, so the count and sums are wide enough for any advert rate over
+// the longest slot.
+struct AggregateField {
+  int32_t min;
+  int32_t max;
+  int32_t last;
+
+  void set(int32_t v) { min = max = last = v; }
+
+  void add(int32_t v) {
+    if (v < min) min = v;
+    if (v > max) max = v;
+    last = v;
+  }
+};
+
+struct AggregateBucket {
+  uint32_t start;
+  uint32_t count;
+  int64_t tempSum;
+  int64_t valueSum;
+  AggregateField temp;
+  AggregateField value;
+
+  int32_t getTempMean() const {
+    return count ? static_cast<int32_t>(tempSum / count) : 0;
+  }
+  int32_t getValueMean() const {
+    return count ? static_cast<int32_t>(valueSum / count) : 0;
+  }
+};
+
+static_assert(sizeof(AggregateBucket) == 48, "AggregateBucket layout changed");
+
+struct AggregateLevel {
+  uint32_t seconds;
+  uint16_t rows;
+  uint16_t offset;  // First bucket of the level
+};
+
+constexpr size_t AGGREGATE_LEVELS = 4;
+constexpr AggregateLevel AGGREGATE_LAYOUT[AGGREGATE_LEVELS] = {
+    {60, 60, 0}, {900, 96, 60}, {3600, 72, 156}, {86400, 60, 228}};
+constexpr size_t AGGREGATE_ROWS = 288;
+
+static_assert(AGGREGATE_LAYOUT[AGGREGATE_LEVELS - 1].offset +
+                      AGGREGATE_LAYOUT[AGGREGATE_LEVELS - 1].rows ==
+                  AGGREGATE_ROWS,
+              "AGGREGATE_ROWS does not match the layout");
+
+// Aggregates of one device, the buckets are a slice of a buffer owned by the
+// measurement list.
+class AggregateSet {
+ private:
+  AggregateBucket* _buckets = nullptr;
+
+ public:
+  void attach(AggregateBucket* buckets) {
+    _buckets = buckets;
+    clear();
+  }
+
+  bool isEnabled() const { return _buckets != nullptr; }
+
+  void clear() {
+    if (_buckets) memset(_buckets, 0, sizeof(AggregateBucket) * AGGREGATE_ROWS);
+  }
+
+  void add(const HistorySample& sample) {
+    if (!_buckets) return;
+
+    for (const AggregateLevel& level : AGGREGATE_LAYOUT) {
+      uint32_t slot = sample.time / level.seconds;
+      uint32_t start = slot * level.seconds;
+      AggregateBucket& bucket = _buckets[level.offset + slot % level.rows];
+
+      if (bucket.count && bucket.start == start) {
+        bucket.count++;
+        bucket.tempSum += sample.temp;
+        bucket.valueSum += sample.value;
+        bucket.temp.add(sample.temp);
+        bucket.value.add(sample.value);
+      } else if (!bucket.count || bucket.start < start) {  // Reuse the bucket
+        bucket.start = start;
+        bucket.count = 1;
+        bucket.tempSum = sample.temp;
+        bucket.valueSum = sample.value;
+        bucket.temp.set(sample.temp);
+        bucket.value.set(sample.value);
+      }
+    }
+  }
+
+  // Bucket covering time at a level, nullptr if there is no data for it
+  const AggregateBucket* find(size_t level, uint32_t time) const {
+    if (!_buckets || level >= AGGREGATE_LEVELS) return nullptr;
+
+    const AggregateLevel& l = AGGREGATE_LAYOUT[level];
+    uint32_t slot = time / l.seconds;
+    const AggregateBucket& bucket = _buckets[l.offset + slot % l.rows];
+
+    return bucket.count && bucket.start == slot * l.seconds ? &bucket
+                                                             : nullptr;
+  }
+
+  // All buckets of a level in storage order, see the layout above
+  const AggregateBucket* getLevel(size_t level) const {
+    if (!_buckets || level >= AGGREGATE_LEVELS) return nullptr;
+    return &_buckets[AGGREGATE_LAYOUT[level].offset];
+  }
+};
+
+#endif  // GATEWAY
+
+#endif  // SRC_MEASUREMENT_AGGREGATE_HPP_
@@ -0,0 +1,597 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_MEASUREMENT_BINARY_HPP_
+#define SRC_MEASUREMENT_BINARY_HPP_
+
+#if defined(GATEWAY)
+
+#include <cmath>
+#include <crc32.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <measurement.hpp>
+
+// Binary measurement log (version 1, 2 with series). The file is a sequence
+// of 32 byte little endian records:
+//
+//   header      once at the start of the file, magic "GWBL" and version
+//   data        one measurement, values in fixed point (see below)
+//   text        name or token of a gravitymon/pressuremon, only written when
+//               it differs from the last one written for the device
+//   series      compressed samples of one device followed by up to
+//               BINARY_SERIES_SLOTS payload slots (version 2 files only, see
+//               measurement_series.hpp)
+//   block end   closes a block of up to BINARY_BLOCK_RECORDS records with
+//               their count and CRC-32
+//
+// Records are only valid once their block end has been read, a torn block at
+// the end of the file is dropped. Slots that are all zero are skipped.
+//
+// The values are rounded to the decimals printed in the v1 CSV, so the CSV
+// can be regenerated exactly from the binary log (formatBinaryCsv()):
+//
+//   type         value[0]      value[1]       value[2]      value[3]  value[4]
+//   ------------------------------------------------------------------------
+//   Tilt         temp C x100   gravity x1e4   tx power      rssi      -
+//   Gravitymon   temp C x100   gravity x1e4   angle x1e4    V x100    ints
+//   Pressuremon  temp C x100   psi x1e4       psi1 x1e4     V x100    ints
+//   Chamber      chamber x100  beer x100      rssi          -         -
+//   RAPT         temp C x100   gravity x1e4   angle x1e4    V x100    ints
+//
+// ints packs tx power (bits 0-7), rssi (bits 8-15) and interval (bits 16-31).
+
+constexpr uint32_t BINARY_LOG_MAGIC = 0x4c425747;  // "GWBL"
+constexpr uint8_t BINARY_LOG_VERSION = 1;
+constexpr uint8_t BINARY_LOG_VERSION_SERIES = 2;
+constexpr size_t BINARY_RECORD_SIZE = 32;
+constexpr uint32_t BINARY_BLOCK_RECORDS = 31;
+constexpr size_t BINARY_TEXT_PART = 20;
+constexpr uint32_t BINARY_SERIES_SLOTS = 7;
+
+enum BinaryRecordKind {
+  BinaryEmpty = 0,
+  BinaryHeader = 1,
+  BinaryData = 2,
+  BinaryText = 3,
+  BinaryBlockEnd = 4,
+  BinarySeries = 5,
+};
+
+enum BinaryTextField { BinaryName = 0, BinaryToken = 1 };
+
+struct BinaryHeaderRecord {
+  uint8_t kind;
+  uint8_t version;
+  uint8_t recordSize;
+  uint8_t blockRecords;
+  uint32_t magic;
+  uint32_t created;  // Epoch seconds when the file was started
+  uint8_t reserved[20];
+};
+
+struct BinaryDataRecord {
+  uint8_t kind;
+  uint8_t type;
+  uint8_t source;
+  uint8_t negative;  // Bit n is set if value[n] is a negative zero
+  uint32_t created;
+  uint32_t id;
+  int32_t value[5];
+};
+
+struct BinaryTextRecord {
+  uint8_t kind;
+  uint8_t type;
+  uint8_t field;  // BinaryTextField
+  uint8_t part;   // Index of the BINARY_TEXT_PART chunk
+  uint32_t length;
+  uint32_t id;
+  char text[BINARY_TEXT_PART];
+};
+
+struct BinarySeriesRecord {
+  uint8_t kind;
+  uint8_t type;
+  uint8_t source;  // Source of the first sample
+  uint8_t slots;   // Payload slots following this record
+  uint32_t first;  // Time of the first sample
+  uint32_t id;
+  uint32_t last;   // Time of the last sample
+  uint16_t count;  // Samples in the payload
+  uint16_t bits;   // Payload length in bits
+  uint8_t reserved[12];
+};
+
+struct BinaryBlockEndRecord {
+  uint8_t kind;
+  uint8_t reserved[3];
+  uint32_t sequence;  // Block number in the file
+  uint32_t count;     // Records in the block
+  uint32_t crc;       // CRC-32 of the records in the block
+  uint8_t reserved1[16];
+};
+
+static_assert(sizeof(BinaryHeaderRecord) == BINARY_RECORD_SIZE &&
+                  sizeof(BinaryDataRecord) == BINARY_RECORD_SIZE &&
+                  sizeof(BinaryTextRecord) == BINARY_RECORD_SIZE &&
+                  sizeof(BinarySeriesRecord) == BINARY_RECORD_SIZE &&
+                  sizeof(BinaryBlockEndRecord) == BINARY_RECORD_SIZE,
+              "Binary log records should be 32 bytes");
+
+// Rounds like printf("%.<n>f") does, the float times the scale is exact in a
+// double so rint() rounds half to even on the exact value.
+inline int32_t toFixedPoint(float value, int32_t scale, uint8_t* negative,
+                            int index) {
+  double scaled = rint(static_cast<double>(value) * scale);
+
+  if (scaled == 0 && std::signbit(value)) *negative |= 1 << index;
+  if (scaled > INT32_MAX) return INT32_MAX;
+  if (scaled < -INT32_MAX) return -INT32_MAX;
+  return static_cast<int32_t>(scaled);
+}
+
+inline char* formatFixedPoint(int32_t value, int decimals, bool negative,
+                              char* buf, size_t len) {
+  int32_t scale = decimals == 4 ? 10000 : 100;
+  uint32_t abs = value < 0 ? -static_cast<int64_t>(value) : value;
+
+  snprintf(buf, len, "%s%u.%0*u", value < 0 || negative ? "-" : "",
+           static_cast<unsigned>(abs / scale), decimals,
+           static_cast<unsigned>(abs % scale));
+  return buf;
+}
+
+inline int32_t packInts(int txPower, int rssi, int interval) {
+  if (interval < 0) interval = 0;
+  if (interval > 0xffff) interval = 0xffff;
+  return static_cast<int32_t>(static_cast<uint8_t>(txPower) |
+                              static_cast<uint8_t>(rssi) << 8 |
+                              static_cast<uint32_t>(interval) << 16);
+}
+
+inline int unpackTxPower(int32_t ints) { return static_cast<int8_t>(ints); }
+inline int unpackRssi(int32_t ints) { return static_cast<int8_t>(ints >> 8); }
+inline int unpackInterval(int32_t ints) {
+  return static_cast<uint32_t>(ints) >> 16;
+}
+
+// Converts a measurement to a data record, false for unknown types
+inline bool toBinaryRecord(const Measurement& measurement,
+                           BinaryDataRecord* record) {
+  const MeasurementBaseData* data = measurement.getData();
+
+  memset(record, 0, sizeof(*record));
+  record->kind = BinaryData;
+  record->type = data->getType();
+  record->source = data->getSource();
+  record->created = data->getCreated();
+  record->id = data->getNumericId();
+  int32_t* v = &record->value[0];
+  uint8_t* neg = &record->negative;
+
+  switch (data->getType()) {
+    case MeasurementType::Tilt:
+    case MeasurementType::TiltPro: {
+      const TiltData* d = measurement.getTiltData();
+      v[0] = toFixedPoint(d->getTempC(), 100, neg, 0);
+      v[1] = toFixedPoint(d->getGravity(), 10000, neg, 1);
+      v[2] = d->getTxPower();
+      v[3] = d->getRssi();
+    } break;
+    case MeasurementType::Gravitymon: {
+      const GravityData* d = measurement.getGravityData();
+      v[0] = toFixedPoint(d->getTempC(), 100, neg, 0);
+      v[1] = toFixedPoint(d->getGravity(), 10000, neg, 1);
+      v[2] = toFixedPoint(d->getAngle(), 10000, neg, 2);
+      v[3] = toFixedPoint(d->getBattery(), 100, neg, 3);
+      v[4] = packInts(d->getTxPower(), d->getRssi(), d->getInterval());
+    } break;
+    case MeasurementType::Pressuremon: {
+      const PressureData* d = measurement.getPressureData();
+      v[0] = toFixedPoint(d->getTempC(), 100, neg, 0);
+      v[1] = toFixedPoint(d->getPressure(), 10000, neg, 1);
+      v[2] = toFixedPoint(d->getPressure1(), 10000, neg, 2);
+      v[3] = toFixedPoint(d->getBattery(), 100, neg, 3);
+      v[4] = packInts(d->getTxPower(), d->getRssi(), d->getInterval());
+    } break;
+    case MeasurementType::Chamber: {
+      const ChamberData* d = measurement.getChamberData();
+      v[0] = toFixedPoint(d->getChamberTempC(), 100, neg, 0);
+      v[1] = toFixedPoint(d->getBeerTempC(), 100, neg, 1);
+      v[2] = d->getRssi();
+    } break;
+    case MeasurementType::Rapt: {
+      const RaptData* d = measurement.getRaptData();
+      v[0] = toFixedPoint(d->getTempC(), 100, neg, 0);
+      v[1] = toFixedPoint(d->getGravity(), 10000, neg, 1);
+      v[2] = toFixedPoint(d->getAngle(), 10000, neg, 2);
+      v[3] = toFixedPoint(d->getBattery(), 100, neg, 3);
+      v[4] = packInts(d->getTxPower(), d->getRssi(), 0);
+    } break;
+    default:
+      return false;
+  }
+
+  return true;
+}
+
+// Turns measurements into binary log records. The caller appends the
+// returned bytes to the file in order.
+class BinaryLogEncoder {
+ public:
+  // Largest output of encode(), two parts of name and token, the data
+  // record and a block end
+  static constexpr size_t MAX_OUTPUT = 6 * BINARY_RECORD_SIZE;
+  // Largest output of encodeSeries(), block end, series record, payload and
+  // block end
+  static constexpr size_t MAX_SERIES_OUTPUT =
+      (3 + BINARY_SERIES_SLOTS) * BINARY_RECORD_SIZE;
+
+  // Starts a new file, names and tokens are written again
+  void reset() {
+    _count = 0;
+    _crc = 0;
+    _sequence = 0;
+    memset(&_texts[0], 0, sizeof(_texts));
+  }
+
+  size_t encodeHeader(uint32_t created, uint8_t* out,
+                      uint8_t version = BINARY_LOG_VERSION) {
+    BinaryHeaderRecord header = {};
+
+    header.kind = BinaryHeader;
+    header.version = version;
+    header.recordSize = BINARY_RECORD_SIZE;
+    header.blockRecords = BINARY_BLOCK_RECORDS;
+    header.magic = BINARY_LOG_MAGIC;
+    header.created = created;
+    memcpy(out, &header, sizeof(header));
+    return sizeof(header);
+  }
+
+  // Writes the records for one measurement to out (MAX_OUTPUT bytes)
+  size_t encode(const Measurement& measurement, uint8_t* out) {
+    BinaryDataRecord record;
+    uint8_t* pos = out;
+
+    if (!toBinaryRecord(measurement, &record)) return 0;
+
+    pos += encodeTexts(measurement, pos);
+    pos = addRecord(&record, pos);
+    return pos - out;
+  }
+
+  // True if the name or token differs from the last one written
+  bool hasNewTexts(const Measurement& measurement) const {
+    const char *name, *token;
+    uint32_t hash;
+
+    if (!getTexts(measurement, &name, &token)) return false;
+    return findText(measurement.getData(), name, token, &hash) != hash;
+  }
+
+  // Writes the name and token records if they have changed (MAX_OUTPUT
+  // bytes)
+  size_t encodeTexts(const Measurement& measurement, uint8_t* out) {
+    const MeasurementBaseData* data = measurement.getData();
+    const char *name, *token;
+    uint32_t hash;
+    uint8_t* pos = out;
+
+    if (!getTexts(measurement, &name, &token) ||
+        findText(data, name, token, &hash) == hash)
+      return 0;
+
+    pos = encodeText(data, BinaryName, name, pos);
+    pos = encodeText(data, BinaryToken, token, pos);
+
+    TextCache& cache = _texts[data->getKey().hash() % TEXT_CACHE_SIZE];
+    cache.id = data->getNumericId();
+    cache.type = data->getType();
+    cache.hash = hash;
+    return pos - out;
+  }
+
+  // Writes a series record and its payload slots (MAX_SERIES_OUTPUT bytes).
+  // They are kept in one block, which is closed first if they do not fit.
+  size_t encodeSeries(const BinarySeriesRecord& header, const uint8_t* payload,
+                      uint8_t* out) {
+    uint8_t* pos = out;
+
+    if (_count + 1 + header.slots > BINARY_BLOCK_RECORDS) pos += endBlock(pos);
+
+    pos = addRecord(&header, pos);
+    for (uint32_t i = 0; i < header.slots; i++)
+      pos = addRecord(payload + i * BINARY_RECORD_SIZE, pos);
+    return pos - out;
+  }
+
+  // Closes the open block, returns 0 if there is none
+  size_t endBlock(uint8_t* out) {
+    if (_count == 0) return 0;
+
+    BinaryBlockEndRecord end = {};
+    end.kind = BinaryBlockEnd;
+    end.sequence = _sequence++;
+    end.count = _count;
+    end.crc = _crc;
+    memcpy(out, &end, sizeof(end));
+
+    _count = 0;
+    _crc = 0;
+    return sizeof(end);
+  }
+
+  bool hasOpenBlock() const { return _count > 0; }
+
+ private:
+  static constexpr size_t TEXT_CACHE_SIZE = 64;
+
+  // Hash of the name and token last written per device, direct mapped so a
+  // collision only means the text is written again
+  struct TextCache {
+    uint32_t id;
+    uint8_t type;
+    uint32_t hash;
+  };
+
+  uint32_t _count = 0;
+  uint32_t _crc = 0;
+  uint32_t _sequence = 0;
+  TextCache _texts[TEXT_CACHE_SIZE] = {};
+
+  uint8_t* addRecord(const void* record, uint8_t* out) {
+    memcpy(out, record, BINARY_RECORD_SIZE);
+    _crc = crc32Update(_crc, out, BINARY_RECORD_SIZE);
+    out += BINARY_RECORD_SIZE;
+
+    if (++_count == BINARY_BLOCK_RECORDS) out += endBlock(out);
+    return out;
+  }
+
+  static bool getTexts(const Measurement& measurement, const char** name,
+                       const char** token) {
+    switch (measurement.getData()->getType()) {
+      case MeasurementType::Gravitymon:
+        *name = measurement.getGravityData()->getName();
+        *token = measurement.getGravityData()->getToken();
+        return true;
+      case MeasurementType::Pressuremon:
+        *name = measurement.getPressureData()->getName();
+        *token = measurement.getPressureData()->getToken();
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  // Returns the hash last written for the device and the hash of the texts
+  uint32_t findText(const MeasurementBaseData* data, const char* name,
+                    const char* token, uint32_t* hash) const {
+    const TextCache& cache = _texts[data->getKey().hash() % TEXT_CACHE_SIZE];
+
+    *hash = crc32Update(crc32(name, strlen(name) + 1), token,
+                        strlen(token) + 1);
+
+    // A new device starts with an empty name and token
+    bool known = cache.id == data->getNumericId() &&
+                 cache.type == data->getType();
+    return known ? cache.hash : crc32("\0\0", 2);
+  }
+
+  uint8_t* encodeText(const MeasurementBaseData* data, BinaryTextField field,
+                      const char* text, uint8_t* out) {
+    size_t length = strlen(text);
+    uint8_t part = 0;
+
+    do {
+      BinaryTextRecord record = {};
+      size_t offset = part * BINARY_TEXT_PART;
+      size_t n = length - offset < BINARY_TEXT_PART ? length - offset
+                                                    : BINARY_TEXT_PART;
+
+      record.kind = BinaryText;
+      record.type = data->getType();
+      record.field = field;
+      record.part = part++;
+      record.length = length;
+      record.id = data->getNumericId();
+      memcpy(&record.text[0], text + offset, n);
+      out = addRecord(&record, out);
+    } while (part * BINARY_TEXT_PART < length);
+
+    return out;
+  }
+};
+
+// Collects the records of a block and releases them when the block end
+// confirms the count and CRC.
+class BinaryLogReader {
+ public:
+  enum Result { Pending, Header, Block, Corrupt };
+
+  // Feeds the next 32 byte slot. After Block the records are available
+  // through size() and record() until the next call.
+  Result add(const uint8_t* slot) {
+    if (_complete) {
+      _count = 0;
+      _crc = 0;
+      _complete = false;
+    }
+
+    // Payload of a series record, the first byte is not a kind
+    if (_payload > 0) {
+      _payload--;
+      memcpy(&_records[_count++][0], slot, BINARY_RECORD_SIZE);
+      _crc = crc32Update(_crc, slot, BINARY_RECORD_SIZE);
+      return Pending;
+    }
+
+    switch (slot[0]) {
+      case BinaryHeader: {
+        BinaryHeaderRecord header;
+        memcpy(&header, slot, sizeof(header));
+        _count = 0;
+        _crc = 0;
+        if (header.magic != BINARY_LOG_MAGIC ||
+            header.version < BINARY_LOG_VERSION ||
+            header.version > BINARY_LOG_VERSION_SERIES)
+          return Corrupt;
+        _version = header.version;
+        return Header;
+      }
+
+      case BinaryData:
+      case BinaryText:
+      case BinarySeries: {
+        uint32_t slots = slot[0] == BinarySeries ? 1 + slot[3] : 1;
+
+        if (slots > 1 + BINARY_SERIES_SLOTS) {
+          if (_count) _corrupt++;
+          _count = 0;
+          _crc = 0;
+          return Pending;
+        }
+        if (_count + slots > BINARY_BLOCK_RECORDS) {
+          _count = 0;  // Block end missing
+          _crc = 0;
+          _corrupt++;
+        }
+        _payload = slots - 1;
+        memcpy(&_records[_count++][0], slot, BINARY_RECORD_SIZE);
+        _crc = crc32Update(_crc, slot, BINARY_RECORD_SIZE);
+        return Pending;
+      }
+
+      case BinaryBlockEnd: {
+        BinaryBlockEndRecord end;
+        memcpy(&end, slot, sizeof(end));
+        _complete = true;
+        if (end.count != _count || end.crc != _crc) {
+          _count = 0;
+          _corrupt++;
+          return Corrupt;
+        }
+        _blocks++;
+        return Block;
+      }
+
+      default:
+        // Padding or garbage, drops an unfinished block
+        if (_count) _corrupt++;
+        _count = 0;
+        _crc = 0;
+        return Pending;
+    }
+  }
+
+  // Records of a block that was never closed (torn end of the file)
+  uint32_t getUnfinished() const { return _complete ? 0 : _count; }
+
+  uint32_t size() const { return _count; }
+  const uint8_t* record(uint32_t index) const { return &_records[index][0]; }
+  // Slots taken by the record, a series record is followed by its payload
+  uint32_t slots(uint32_t index) const {
+    return _records[index][0] == BinarySeries ? 1 + _records[index][3] : 1;
+  }
+
+  // Version from the last header, series records need version 2
+  uint8_t getVersion() const { return _version; }
+
+  uint32_t getBlocks() const { return _blocks; }
+  uint32_t getCorrupt() const { return _corrupt; }
+
+ private:
+  uint8_t _records[BINARY_BLOCK_RECORDS][BINARY_RECORD_SIZE];
+  uint32_t _count = 0;
+  uint32_t _crc = 0;
+  uint32_t _payload = 0;  // Payload slots still to come
+  bool _complete = false;
+  uint8_t _version = 0;
+  uint32_t _blocks = 0;
+  uint32_t _corrupt = 0;
+};
+
+// Formats a data record as the v1 CSV line written by Measurement::formatCsv
+inline size_t formatBinaryCsv(const BinaryDataRecord& record, const char* name,
+                              const char* token, char* buffer, size_t len) {
+  // Only used for the type, source and id strings
+  MeasurementBaseData base(record.id,
+                           static_cast<MeasurementType>(record.type),
+                           static_cast<MeasurementSource>(record.source));
+  const int32_t* v = &record.value[0];
+  char created[20], f[5][16];
+  int n;
+
+  for (int i = 0; i < 4; i++) {
+    formatFixedPoint(v[i],
+                     i == 0 || i == 3 || record.type == MeasurementType::Chamber
+                         ? 2
+                         : 4,
+                     record.negative & (1 << i), f[i], sizeof(f[i]));
+  }
+  Clock::format(record.created, created, sizeof(created));
+
+  switch (record.type) {
+    case MeasurementType::Tilt:
+    case MeasurementType::TiltPro:
+      n = snprintf(buffer, len, "1,%s,%s,%s,%s,%s,%s,%s,%d,%d,,,,",
+                   base.getTypeAsString(), base.getSourceAsString(), created,
+                   base.getId(), tiltColorToString(static_cast<TiltColor>(
+                                     static_cast<int32_t>(record.id))),
+                   f[0], f[1], v[2], v[3]);
+      break;
+    case MeasurementType::Gravitymon:
+    case MeasurementType::Pressuremon:
+      n = snprintf(buffer, len, "1,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%d,%d,%d",
+                   base.getTypeAsString(), base.getSourceAsString(), created,
+                   base.getId(), name, token, f[0], f[1], f[2], f[3],
+                   unpackTxPower(v[4]), unpackRssi(v[4]),
+                   unpackInterval(v[4]));
+      break;
+    case MeasurementType::Chamber:
+      n = snprintf(buffer, len, "1,%s,%s,%s,%s,%s,%s,%d,,,,,,",
+                   base.getTypeAsString(), base.getSourceAsString(), created,
+                   base.getId(), f[0], f[1], v[2]);
+      break;
+    case MeasurementType::Rapt:
+      n = snprintf(buffer, len, "1,%s,%s,%s,%s,%s,%s,%s,%s,%d,%d,,,",
+                   base.getTypeAsString(), base.getSourceAsString(), created,
+                   base.getId(), f[0], f[1], f[2], f[3], unpackTxPower(v[4]),
+                   unpackRssi(v[4]));
+      break;
+    default:
+      return 0;
+  }
+
+  return MeasurementBaseData::endCsvLine(buffer, len, n);
+}
+
+#endif  // GATEWAY
+
+#endif  // SRC_MEASUREMENT_BINARY_HPP_
+
+// EOF
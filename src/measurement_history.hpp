@@ -0,0 +1,173 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_MEASUREMENT_HISTORY_HPP_
+#define SRC_MEASUREMENT_HISTORY_HPP_
+
+#if defined(GATEWAY)
+
+#include <cstddef>
+#include <cstdint>
+
+// One historic reading in fixed point, using the scales of the BLE formats.
+// What the values hold depends on the device type:
+//
+//   type         temp (x1000)   value (int32)        value1 (x100)  battery
+//   ----------------------------------------------------------------------
+//   Tilt         temp C         gravity x10000       -              -
+//   Gravitymon   temp C         gravity x10000       angle          V x1000
+//   Pressuremon  temp C         pressure PSI x100    pressure1 PSI  V x1000
+//   Chamber      chamber temp C beer temp C x1000    -              -
+//   RAPT         temp C         gravity x10000       angle          V x1000
+struct HistorySample {
+  uint32_t time;     // Epoch seconds
+  int32_t temp;      // C x1000
+  int32_t value;     // Gravity, pressure or beer temperature, see above
+  int16_t value1;    // Angle or pressure1 x100
+  uint16_t battery;  // V x1000
+};
+
+static_assert(sizeof(HistorySample) == 16, "HistorySample should be packed");
+
+// Circular buffer of the last samples of one device, the storage is a slice
+// of a buffer owned by the measurement list. Samples are kept in time order,
+// the oldest is overwritten when full.
+class HistoryRing {
+ private:
+  HistorySample* _samples = nullptr;
+  uint16_t _capacity = 0;
+  uint16_t _head = 0;  // Next position to write
+  uint16_t _count = 0;
+
+ public:
+  // Position of the ring copied once, readers iterate over a view. A reader
+  // racing the writer may see samples that the seqlock retry throws away,
+  // but the indices are kept within the slice so it never reads outside it.
+  class View {
+   private:
+    const HistorySample* _samples;
+    uint16_t _capacity;
+    uint16_t _head;
+    uint16_t _count;
+
+   public:
+    View(const HistorySample* samples, uint16_t capacity, uint16_t head,
+         uint16_t count)
+        : _samples(samples),
+          _capacity(capacity),
+          _head(head < capacity ? head : 0),
+          _count(count < capacity ? count : capacity) {}
+
+    size_t size() const { return _count; }
+
+    // Index 0 is the oldest sample, index < size()
+    const HistorySample& at(size_t index) const {
+      return _samples[(_head + _capacity - _count + index) % _capacity];
+    }
+
+    // Index of the first sample at or after time, size() if there is none
+    size_t lowerBound(uint32_t time) const {
+      size_t first = 0, count = _count;
+
+      while (count > 0) {
+        size_t step = count / 2;
+
+        if (at(first + step).time < time) {
+          first += step + 1;
+          count -= step + 1;
+        } else {
+          count = step;
+        }
+      }
+      return first;
+    }
+  };
+
+  class Iterator {
+   private:
+    View _view;
+    size_t _index;
+
+   public:
+    Iterator(const View& view, size_t index) : _view(view), _index(index) {}
+
+    const HistorySample& operator*() const { return _view.at(_index); }
+    const HistorySample* operator->() const { return &_view.at(_index); }
+    Iterator& operator++() {
+      _index++;
+      return *this;
+    }
+    bool operator!=(const Iterator& other) const {
+      return _index != other._index;
+    }
+  };
+
+  void attach(HistorySample* samples, uint16_t capacity) {
+    _samples = samples;
+    _capacity = capacity;
+    clear();
+  }
+
+  void clear() { _head = _count = 0; }
+
+  size_t size() const { return _count; }
+  size_t capacity() const { return _capacity; }
+  bool empty() const { return _count == 0; }
+
+  View view() const { return View(_samples, _capacity, _head, _count); }
+  const HistorySample& at(size_t index) const { return view().at(index); }
+  const HistorySample& back() const { return at(_count - 1); }
+
+  void push(const HistorySample& sample) {
+    if (!_capacity) return;
+
+    // A clock that was set backwards would break the time order
+    if (_count && sample.time < back().time) clear();
+
+    _samples[_head] = sample;
+    _head = _head + 1 == _capacity ? 0 : _head + 1;
+    if (_count < _capacity) _count++;
+  }
+
+  // Samples with from <= time < to, for use in a range based for loop
+  class Range {
+   private:
+    Iterator _begin, _end;
+
+   public:
+    Range(const Iterator& b, const Iterator& e) : _begin(b), _end(e) {}
+    Iterator begin() const { return _begin; }
+    Iterator end() const { return _end; }
+  };
+
+  // Both ends come from the same view of the ring
+  Range range(uint32_t from, uint32_t to) const {
+    View v = view();
+    return Range(Iterator(v, v.lowerBound(from)),
+                 Iterator(v, v.lowerBound(to)));
+  }
+};
+
+#endif  // GATEWAY
+
+#endif  // SRC_MEASUREMENT_HISTORY_HPP_
@@ -0,0 +1,150 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_MEASUREMENT_INDEX_HPP_
+#define SRC_MEASUREMENT_INDEX_HPP_
+
+#if defined(GATEWAY)
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Identifies a device by the numeric id found in the advertisement (chip id,
+// tilt color or the end of the mac address) and a tag telling which kind of
+// device it is, the same chip id can be used by a gravitymon and a
+// pressuremon.
+struct DeviceKey {
+  uint32_t id = 0;
+  uint8_t tag = 0;
+
+  DeviceKey() {}
+  DeviceKey(uint32_t i, uint8_t t) : id(i), tag(t) {}
+
+  bool operator==(const DeviceKey& other) const {
+    return id == other.id && tag == other.tag;
+  }
+  bool operator!=(const DeviceKey& other) const { return !(*this == other); }
+
+  uint32_t hash() const {
+    // Fibonacci hashing spreads the sequential chip ids over the table
+    return (id ^ (static_cast<uint32_t>(tag) << 24)) * 2654435761u;
+  }
+};
+
+// Open addressed hash table (linear probing) from a device key to a value,
+// sized once to at least twice the number of devices so a probe sequence
+// stays short. Removal shifts the following entries back instead of leaving
+// tombstones, lookups never degrade after many evictions.
+template <typename T>
+class DeviceIndex {
+ private:
+  struct Slot {
+    DeviceKey key;
+    T value;
+    bool used;
+  };
+
+  std::unique_ptr<Slot[]> _slots;
+  size_t _mask = 0;
+  size_t _size = 0;
+
+  size_t home(const DeviceKey& key) const {
+    return (key.hash() >> 8) & _mask;
+  }
+
+  size_t locate(const DeviceKey& key) const {
+    size_t i = home(key);
+
+    while (_slots[i].used && _slots[i].key != key) i = (i + 1) & _mask;
+    return i;
+  }
+
+ public:
+  explicit DeviceIndex(size_t capacity) {
+    size_t slots = 8;
+
+    while (slots < capacity * 2) slots <<= 1;
+    _slots.reset(new Slot[slots]());
+    _mask = slots - 1;
+  }
+
+  size_t size() const { return _size; }
+  size_t slots() const { return _mask + 1; }
+
+  // Returns a pointer to the stored value or nullptr if not found
+  T* find(const DeviceKey& key) const {
+    size_t i = locate(key);
+    return _slots[i].used ? &_slots[i].value : nullptr;
+  }
+
+  // Adds or replaces the value, fails only when the table is full
+  bool insert(const DeviceKey& key, const T& value) {
+    size_t i = locate(key);
+
+    if (!_slots[i].used) {
+      if (_size + 1 > _mask) return false;  // Keep one empty slot as sentinel
+      _slots[i].key = key;
+      _slots[i].used = true;
+      _size++;
+    }
+
+    _slots[i].value = value;
+    return true;
+  }
+
+  bool erase(const DeviceKey& key) {
+    size_t i = locate(key);
+
+    if (!_slots[i].used) return false;
+
+    // Move entries back into the hole unless they already sit between their
+    // home slot and the hole.
+    size_t j = i;
+
+    for (;;) {
+      j = (j + 1) & _mask;
+      if (!_slots[j].used) break;
+
+      size_t k = home(_slots[j].key);
+
+      if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+        _slots[i] = _slots[j];
+        i = j;
+      }
+    }
+
+    _slots[i].used = false;
+    _size--;
+    return true;
+  }
+
+  void clear() {
+    for (size_t i = 0; i <= _mask; i++) _slots[i].used = false;
+    _size = 0;
+  }
+};
+
+#endif  // GATEWAY
+
+#endif  // SRC_MEASUREMENT_INDEX_HPP_
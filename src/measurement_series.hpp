@@ -0,0 +1,382 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_MEASUREMENT_SERIES_HPP_
+#define SRC_MEASUREMENT_SERIES_HPP_
+
+#if defined(GATEWAY)
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <measurement_binary.hpp>
+
+// Compressed time series of one device, stored in the binary log as a series
+// record followed by up to BINARY_SERIES_SLOTS payload slots. The payload is
+// a bit stream (most significant bit first) in the style of the Gorilla
+// paper, the first sample is written in full and the following ones relative
+// to the samples before them:
+//
+//   time      delta of the delta to the previous time (zig-zag)
+//               0                      same interval as last time
+//               10   + 7 bits          -64..63 s
+//               110  + 9 bits          -256..255 s
+//               1110 + 12 bits         -2048..2047 s
+//               1111 + 32 bits         anything else
+//   source    0 if unchanged, otherwise 1 + 8 bits
+//   negative  0 if unchanged, otherwise 1 + 8 bits
+//   values    per channel, delta to the previous value (zig-zag)
+//               0                      unchanged
+//               10   + 6 bits          -32..31
+//               110  + 12 bits         -2048..2047
+//               1110 + 20 bits
+//               1111 + 32 bits
+//
+// The first sample has 32 bits of time, 8 bits of source and negative and 32
+// bits per value. The channels are the values of the data record that are
+// used by the type, see measurement_binary.hpp. Gravity and temperature of a
+// fermenting beer change a few steps at a time and the advert interval is
+// fixed, so a sample mostly needs a few bits instead of 32 bytes.
+
+constexpr size_t SERIES_PAYLOAD_SIZE = BINARY_SERIES_SLOTS * BINARY_RECORD_SIZE;
+
+inline int seriesChannels(uint8_t type) {
+  switch (type) {
+    case MeasurementType::Tilt:
+    case MeasurementType::TiltPro:
+      return 4;
+    case MeasurementType::Chamber:
+      return 3;
+    default:
+      return 5;
+  }
+}
+
+inline uint32_t zigzagEncode(int32_t value) {
+  return (static_cast<uint32_t>(value) << 1) ^
+         static_cast<uint32_t>(value >> 31);
+}
+
+inline int32_t zigzagDecode(uint32_t value) {
+  return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+// Widths of the three short forms, the long form always has 32 bits
+constexpr uint8_t SERIES_TIME_WIDTHS[3] = {7, 9, 12};
+constexpr uint8_t SERIES_VALUE_WIDTHS[3] = {6, 12, 20};
+
+// Appends bits to a caller owned buffer
+class BitWriter {
+ public:
+  void attach(uint8_t* data, size_t bytes) {
+    _data = data;
+    _capacity = bytes * 8;
+    _bits = 0;
+  }
+
+  // Writes the lowest count bits of value, false if they do not fit
+  bool write(uint32_t value, int count) {
+    if (_bits + count > _capacity) return false;
+
+    while (count > 0) {
+      int free = 8 - (_bits & 7);
+      int n = count < free ? count : free;
+      uint8_t part = (value >> (count - n)) & ((1u << n) - 1);
+
+      // Clears what an attempt that was truncated left behind
+      uint8_t& byte = _data[_bits >> 3];
+      byte = (byte & ~((1u << free) - 1)) | part << (free - n);
+      _bits += n;
+      count -= n;
+    }
+    return true;
+  }
+
+  // Zero, or the shortest prefix coded form of a zig-zag value
+  bool writeVariable(uint32_t value, const uint8_t widths[3]) {
+    if (value == 0) return write(0, 1);
+
+    for (int i = 0; i < 3; i++) {
+      if (value < (1u << widths[i]))
+        return write(((1u << (i + 1)) - 1) << 1, i + 2) &&
+               write(value, widths[i]);
+    }
+    return write(0xf, 4) && write(value, 32);
+  }
+
+  // Zero if unchanged, otherwise one and the byte
+  bool writeByte(uint8_t value, uint8_t last) {
+    return value == last ? write(0, 1) : write(0x100 | value, 9);
+  }
+
+  size_t size() const { return _bits; }
+  void truncate(size_t bits) { _bits = bits; }
+
+ private:
+  uint8_t* _data = nullptr;
+  size_t _capacity = 0;
+  size_t _bits = 0;
+};
+
+// Reads the bits written by BitWriter
+class BitReader {
+ public:
+  BitReader(const uint8_t* data, size_t bits) : _data(data), _end(bits) {}
+
+  bool read(int count, uint32_t* value) {
+    if (_bits + count > _end) return false;
+
+    uint32_t v = 0;
+    while (count > 0) {
+      int free = 8 - (_bits & 7);
+      int n = count < free ? count : free;
+
+      v = (v << n) | ((_data[_bits >> 3] >> (free - n)) & ((1u << n) - 1));
+      _bits += n;
+      count -= n;
+    }
+    *value = v;
+    return true;
+  }
+
+  bool readVariable(const uint8_t widths[3], uint32_t* value) {
+    uint32_t bit;
+    int ones = 0;
+
+    // Up to four bits of prefix, the long form has no terminating zero
+    while (ones < 4) {
+      if (!read(1, &bit)) return false;
+      if (!bit) break;
+      ones++;
+    }
+
+    if (ones == 0) {
+      *value = 0;
+      return true;
+    }
+    return read(ones == 4 ? 32 : widths[ones - 1], value);
+  }
+
+  bool readByte(uint8_t last, uint8_t* value) {
+    uint32_t v;
+
+    if (!read(1, &v)) return false;
+    if (!v) {
+      *value = last;
+      return true;
+    }
+    if (!read(8, &v)) return false;
+    *value = v;
+    return true;
+  }
+
+ private:
+  const uint8_t* _data;
+  size_t _end;
+  size_t _bits = 0;
+};
+
+// Streaming encoder for the samples of one device. Samples are added until
+// the payload is full, then the owner writes the series with header() and
+// getPayload() and clears the encoder. The buffers may come from
+// allocateBuffer(), clear() must be called before the first use.
+class SeriesEncoder {
+ public:
+  void clear() {
+    _writer.attach(&_payload[0], sizeof(_payload));
+    _count = 0;
+  }
+
+  bool empty() const { return _count == 0; }
+  uint16_t getCount() const { return _count; }
+  uint32_t getFirst() const { return _first; }
+  uint32_t getLast() const { return _time; }
+  DeviceKey getKey() const {
+    return DeviceKey(_id, _type == MeasurementType::TiltPro
+                              ? static_cast<uint8_t>(MeasurementType::Tilt)
+                              : _type);
+  }
+
+  // Appends a sample of the device, false if the payload is full (or the
+  // sample belongs to another device), the encoder is then unchanged
+  bool add(const BinaryDataRecord& record) {
+    size_t mark = _writer.size();
+    int channels = seriesChannels(record.type);
+    bool ok;
+
+    if (_count == 0) {
+      _type = record.type;
+      _id = record.id;
+      _firstSource = record.source;
+      _first = record.created;
+      _delta = 0;
+
+      ok = _writer.write(record.created, 32) &&
+           _writer.write(record.source, 8) &&
+           _writer.write(record.negative, 8);
+      for (int i = 0; ok && i < channels; i++)
+        ok = _writer.write(static_cast<uint32_t>(record.value[i]), 32);
+    } else {
+      if (record.type != _type || record.id != _id || _count == UINT16_MAX)
+        return false;
+
+      int32_t delta = static_cast<int32_t>(record.created - _time);
+
+      ok = _writer.writeVariable(
+               zigzagEncode(static_cast<int32_t>(
+                   static_cast<uint32_t>(delta) - _delta)),
+               SERIES_TIME_WIDTHS) &&
+           _writer.writeByte(record.source, _source) &&
+           _writer.writeByte(record.negative, _negative);
+      for (int i = 0; ok && i < channels; i++) {
+        ok = _writer.writeVariable(
+            zigzagEncode(static_cast<int32_t>(
+                static_cast<uint32_t>(record.value[i]) - _value[i])),
+            SERIES_VALUE_WIDTHS);
+      }
+      if (ok) _delta = delta;
+    }
+
+    if (!ok) {
+      _writer.truncate(mark);
+      return false;
+    }
+
+    _time = record.created;
+    _source = record.source;
+    _negative = record.negative;
+    memcpy(&_value[0], &record.value[0], sizeof(_value));
+    _count++;
+    return true;
+  }
+
+  BinarySeriesRecord header() const {
+    BinarySeriesRecord header = {};
+
+    header.kind = BinarySeries;
+    header.type = _type;
+    header.source = _firstSource;
+    header.slots = (_writer.size() + BINARY_RECORD_SIZE * 8 - 1) /
+                   (BINARY_RECORD_SIZE * 8);
+    header.first = _first;
+    header.id = _id;
+    header.last = _time;
+    header.count = _count;
+    header.bits = _writer.size();
+    return header;
+  }
+
+  // The used part of the last slot is padded with zeros
+  const uint8_t* getPayload() {
+    size_t bits = _writer.size();
+    size_t bytes = (bits + 7) / 8;
+    size_t slots = header().slots;
+
+    if (bits & 7) _payload[bits / 8] &= 0xff00 >> (bits & 7);
+    memset(&_payload[bytes], 0, slots * BINARY_RECORD_SIZE - bytes);
+    return &_payload[0];
+  }
+
+ private:
+  uint8_t _payload[SERIES_PAYLOAD_SIZE];
+  BitWriter _writer;
+  uint16_t _count;
+  uint8_t _type;
+  uint8_t _firstSource;
+  uint32_t _id;
+  uint32_t _first;
+  // Last sample
+  uint32_t _time;
+  int32_t _delta;
+  uint8_t _source;
+  uint8_t _negative;
+  int32_t _value[5];
+};
+
+// Decodes the samples of a series record, payload points to the slots after
+// the record
+class SeriesDecoder {
+ public:
+  SeriesDecoder(const BinarySeriesRecord& header, const uint8_t* payload)
+      : _header(header),
+        _reader(payload, header.bits <= header.slots * BINARY_RECORD_SIZE * 8
+                             ? header.bits
+                             : 0) {}
+
+  // False after the last sample or if the payload is damaged
+  bool next(BinaryDataRecord* record) {
+    int channels = seriesChannels(_header.type);
+    uint32_t v;
+
+    if (_index >= _header.count) return false;
+
+    if (_index == 0) {
+      memset(&_last, 0, sizeof(_last));
+      _last.kind = BinaryData;
+      _last.type = _header.type;
+      _last.id = _header.id;
+
+      if (!_reader.read(32, &_last.created) || !_reader.read(8, &v))
+        return false;
+      _last.source = v;
+      if (!_reader.read(8, &v)) return false;
+      _last.negative = v;
+      for (int i = 0; i < channels; i++) {
+        if (!_reader.read(32, &v)) return false;
+        _last.value[i] = static_cast<int32_t>(v);
+      }
+    } else {
+      if (!_reader.readVariable(SERIES_TIME_WIDTHS, &v)) return false;
+      _delta = static_cast<int32_t>(static_cast<uint32_t>(_delta) +
+                                    static_cast<uint32_t>(zigzagDecode(v)));
+      _last.created += _delta;
+
+      if (!_reader.readByte(_last.source, &_last.source) ||
+          !_reader.readByte(_last.negative, &_last.negative))
+        return false;
+      for (int i = 0; i < channels; i++) {
+        if (!_reader.readVariable(SERIES_VALUE_WIDTHS, &v)) return false;
+        _last.value[i] = static_cast<int32_t>(
+            static_cast<uint32_t>(_last.value[i]) +
+            static_cast<uint32_t>(zigzagDecode(v)));
+      }
+    }
+
+    _index++;
+    *record = _last;
+    return true;
+  }
+
+ private:
+  BinarySeriesRecord _header;
+  BitReader _reader;
+  BinaryDataRecord _last;
+  int32_t _delta = 0;
+  uint32_t _index = 0;
+};
+
+#endif  // GATEWAY
+
+#endif  // SRC_MEASUREMENT_SERIES_HPP_
+
+// EOF
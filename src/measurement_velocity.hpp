@@ -0,0 +1,150 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_MEASUREMENT_VELOCITY_HPP_
+#define SRC_MEASUREMENT_VELOCITY_HPP_
+
+#if defined(GATEWAY)
+
+#include <cstddef>
+#include <cstdint>
+
+// Gravity readings are averaged per interval and the velocity is the slope of
+// a least squares line through the last points, 24 hours with the defaults.
+// A point is placed at the mean time of its readings.
+constexpr uint32_t VELOCITY_INTERVAL = 3600;  // Seconds per point
+constexpr size_t VELOCITY_POINTS = 24;
+constexpr size_t VELOCITY_MIN_POINTS = 3;  // Including the current interval
+
+// Gravity velocity (SG points per 24 hours, negative while fermenting) for
+// any hydrometer. The regression is kept as running integer sums that are
+// updated when a point enters or leaves the window, so adding a reading and
+// reading the velocity are O(1) and the sums never drift.
+class GravityVelocity {
+ private:
+  struct Point {
+    int32_t time;     // Minutes since _base
+    int32_t gravity;  // Mean SG x10000
+  };
+
+  Point _points[VELOCITY_POINTS];
+  uint8_t _head = 0;  // Oldest point
+  uint8_t _count = 0;
+  uint32_t _base = 0;  // Epoch seconds of the first interval
+  uint32_t _slot = 0;  // Start of the current interval, 0 if none
+
+  // Readings in the current interval
+  int32_t _gravitySum = 0;
+  uint32_t _offsetSum = 0;  // Seconds from the interval start
+  uint16_t _gravityCount = 0;
+
+  // Sums over the points in the window
+  int64_t _st = 0;
+  int64_t _sg = 0;
+  int64_t _stt = 0;
+  int64_t _stg = 0;
+
+  void addPoint(const Point& p, int sign) {
+    _st += sign * p.time;
+    _sg += sign * p.gravity;
+    _stt += sign * static_cast<int64_t>(p.time) * p.time;
+    _stg += sign * static_cast<int64_t>(p.time) * p.gravity;
+  }
+
+  Point currentPoint() const {
+    Point p;
+    p.time = (_slot - _base + _offsetSum / _gravityCount) / 60;
+    p.gravity = _gravitySum / _gravityCount;
+    return p;
+  }
+
+  void closeInterval() {
+    if (_count == VELOCITY_POINTS) {
+      addPoint(_points[_head], -1);
+      _head = (_head + 1) % VELOCITY_POINTS;
+      _count--;
+    }
+
+    Point p = currentPoint();
+    _points[(_head + _count) % VELOCITY_POINTS] = p;
+    _count++;
+    addPoint(p, 1);
+  }
+
+ public:
+  void clear() {
+    _head = _count = 0;
+    _slot = 0;
+    _gravitySum = _offsetSum = _gravityCount = 0;
+    _st = _sg = _stt = _stg = 0;
+  }
+
+  // Gravity as SG x10000, time in epoch seconds
+  void add(uint32_t time, int32_t gravity) {
+    uint32_t slot = time - time % VELOCITY_INTERVAL;
+
+    // Start over if the clock was set or the device has been gone too long
+    if (_slot && (slot < _slot ||
+                  slot - _slot >= VELOCITY_INTERVAL * VELOCITY_POINTS))
+      clear();
+
+    if (!_slot) {
+      _base = _slot = slot;
+    } else if (slot != _slot) {
+      closeInterval();
+      _slot = slot;
+      _gravitySum = _offsetSum = _gravityCount = 0;
+    }
+
+    _gravitySum += gravity;
+    _offsetSum += time - slot;
+    _gravityCount++;
+  }
+
+  bool isValid() const {
+    return _gravityCount && _count + 1u >= VELOCITY_MIN_POINTS;
+  }
+
+  // SG points (0.001) per 24 hours, the current interval is included
+  float getVelocity() const {
+    if (!isValid()) return 0;
+
+    Point p = currentPoint();
+    int64_t n = _count + 1;
+    int64_t st = _st + p.time;
+    int64_t sg = _sg + p.gravity;
+    int64_t stt = _stt + static_cast<int64_t>(p.time) * p.time;
+    int64_t stg = _stg + static_cast<int64_t>(p.time) * p.gravity;
+    int64_t d = n * stt - st * st;
+
+    if (d == 0) return 0;
+
+    // Slope is SG x10000 per minute
+    float slope = static_cast<float>(n * stg - st * sg) / d;
+    return slope * 1440 / 10;
+  }
+};
+
+#endif  // GATEWAY
+
+#endif  // SRC_MEASUREMENT_VELOCITY_HPP_
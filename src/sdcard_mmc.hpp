@@ -1,2 +1,86 @@
+/*
+MIT License
 
-// Blank file, not used in this project
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_SDCARD_MMC_HPP_
+#define SRC_SDCARD_MMC_HPP_
+
+#if defined(ENABLE_MMC) && !defined(NATIVE)
+
+#include <SD_MMC.h>
+#include <vfs_api.h>
+
+#include <log.hpp>
+#include <storage.hpp>
+
+// SDMMC pins for the 4 bit bus, the ESP32-S3 routes them through the GPIO
+// matrix so any free pins can be used
+#if !defined(MMC_CLK)
+#define MMC_CLK 36
+#endif
+#if !defined(MMC_CMD)
+#define MMC_CMD 35
+#endif
+#if !defined(MMC_D0)
+#define MMC_D0 37
+#endif
+#if !defined(MMC_D1)
+#define MMC_D1 38
+#endif
+#if !defined(MMC_D2)
+#define MMC_D2 33
+#endif
+#if !defined(MMC_D3)
+#define MMC_D3 34
+#endif
+
+// Bus clock in kHz, 40000 is high speed mode
+#if !defined(MMC_FREQUENCY)
+#define MMC_FREQUENCY SDMMC_FREQ_HIGHSPEED
+#endif
+
+// SD card on the SDMMC peripheral with a 4 bit bus, mounted on /sdcard. A
+// separate instance from SD_MMC so the I/O counters only see the gateway.
+class Storage : public fs::SDMMCFS, public StorageIo {
+ public:
+  Storage() : fs::SDMMCFS(FSImplPtr(new VFSImpl())) {}
+
+  bool begin() {
+    if (!setPins(MMC_CLK, MMC_CMD, MMC_D0, MMC_D1, MMC_D2, MMC_D3) ||
+        !fs::SDMMCFS::begin("/sdcard", false, false, MMC_FREQUENCY)) {
+      Log.error(F("SD  : Failed to mount the SD card (SDMMC)." CR));
+      return false;
+    }
+
+    Log.notice(F("SD  : Mounted SD card (SDMMC 4 bit), %u MB." CR),
+               static_cast<uint32_t>(cardSize() / (1024 * 1024)));
+    return true;
+  }
+
+  bool hasCard() { return cardType() != CARD_NONE; }
+};
+
+#endif  // ENABLE_MMC && !NATIVE
+
+#endif  // SRC_SDCARD_MMC_HPP_
+
+// EOF
@@ -0,0 +1,108 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_SDCARD_POSIX_HPP_
+#define SRC_SDCARD_POSIX_HPP_
+
+#if defined(GATEWAY) && defined(NATIVE)
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <log.hpp>
+#include <storage.hpp>
+
+// Host directory as the SD card of env:native, so the logging path can be
+// benchmarked against a tmpfs, a disk or a slow loop device. Writes bypass
+// the stdio buffer so that each block reaches the kernel when it is counted.
+class Storage : public fs::FS, public StorageIo {
+ public:
+  bool begin(const char* root) {
+    struct stat st;
+
+    if (stat(root, &st) != 0 || !S_ISDIR(st.st_mode)) {
+      Log.error(F("SD  : %s is not a directory." CR), root);
+      return false;
+    }
+
+    setRoot(root);
+    _blockSize = st.st_blksize;
+    _mounted = true;
+    Log.notice(F("SD  : Using %s as SD card, block size %u." CR), root,
+               _blockSize);
+    return true;
+  }
+
+  bool hasCard() { return _mounted; }
+  uint32_t getBlockSize() const override { return _blockSize; }
+
+ protected:
+  // A replay drives micros() from the capture, the counters use the host
+  uint32_t getMicros() const override {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  size_t writeFile(File& file, const uint8_t* data, size_t len) override {
+    FILE* f = file.handle();
+    if (!f || fflush(f) != 0) return 0;
+
+    long pos = ftell(f);  // NOLINT
+    ssize_t n = ::write(fileno(f), data, len);
+    if (n < 0) n = 0;
+
+    // The stream keeps its own position, it must follow the raw write
+    fseek(f, pos + n, SEEK_SET);
+    return n;
+  }
+
+  bool syncFile(File& file) override {
+    FILE* f = file.handle();
+    return f && fflush(f) == 0 && fsync(fileno(f)) == 0;
+  }
+
+  // Reserves the blocks without changing the file size, the recovery at boot
+  // relies on the size
+  bool allocateFile(File& file, uint32_t offset, uint32_t length) override {
+#if defined(__linux__)
+    FILE* f = file.handle();
+    return f && fallocate(fileno(f), FALLOC_FL_KEEP_SIZE, offset, length) == 0;
+#else
+    return false;
+#endif
+  }
+
+ private:
+  uint32_t _blockSize = 512;
+  bool _mounted = false;
+};
+
+#endif  // GATEWAY && NATIVE
+
+#endif  // SRC_SDCARD_POSIX_HPP_
+
+// EOF
@@ -1,2 +1,87 @@
+/*
+MIT License
 
-// Blank file, not used in this project
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_SDCARD_SD_HPP_
+#define SRC_SDCARD_SD_HPP_
+
+#if defined(ENABLE_MMC) && defined(ENABLE_SD)
+#error "Only one of ENABLE_MMC and ENABLE_SD can be defined"
+#endif
+
+#if defined(ENABLE_SD) && !defined(NATIVE)
+
+#include <SD.h>
+#include <SPI.h>
+#include <vfs_api.h>
+
+#include <log.hpp>
+#include <storage.hpp>
+
+// SPI pins, the defaults are the TF card slot of the Lolin S3 Pro
+#if !defined(SD_CS)
+#define SD_CS 46
+#endif
+#if !defined(SD_SCK)
+#define SD_SCK 12
+#endif
+#if !defined(SD_MISO)
+#define SD_MISO 13
+#endif
+#if !defined(SD_MOSI)
+#define SD_MOSI 11
+#endif
+
+// Bus clock in Hz
+#if !defined(SD_FREQUENCY)
+#define SD_FREQUENCY 20000000
+#endif
+
+// SD card in SPI mode on its own bus, mounted on /sd
+class Storage : public fs::SDFS, public StorageIo {
+ public:
+  Storage() : fs::SDFS(FSImplPtr(new VFSImpl())), _spi(FSPI) {}
+
+  bool begin() {
+    _spi.begin(SD_SCK, SD_MISO, SD_MOSI, SD_CS);
+
+    if (!fs::SDFS::begin(SD_CS, _spi, SD_FREQUENCY, "/sd")) {
+      Log.error(F("SD  : Failed to mount the SD card (SPI)." CR));
+      return false;
+    }
+
+    Log.notice(F("SD  : Mounted SD card (SPI), %u MB." CR),
+               static_cast<uint32_t>(cardSize() / (1024 * 1024)));
+    return true;
+  }
+
+  bool hasCard() { return cardType() != CARD_NONE; }
+
+ private:
+  SPIClass _spi;
+};
+
+#endif  // ENABLE_SD && !NATIVE
+
+#endif  // SRC_SDCARD_SD_HPP_
+
+// EOF
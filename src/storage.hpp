@@ -0,0 +1,173 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_STORAGE_HPP_
+#define SRC_STORAGE_HPP_
+
+#if defined(GATEWAY)
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// When a flush of the data logger reaches the card
+enum class SyncPolicy {
+  EveryWrite,  // After every block written, the slowest and safest
+  OnFlush,     // When the logger flushes (DATA_LOGGER_FLUSH_INTERVAL)
+  Interval,    // On a logger flush if the last sync is the interval old
+  Never        // Only when the file is closed, for benchmarks
+};
+
+struct StorageMetrics {
+  uint32_t writes = 0;
+  uint32_t unaligned = 0;  // Writes starting inside a block of the card
+  uint32_t syncs = 0;
+  uint32_t skippedSyncs = 0;  // Sync requests dropped by the policy
+  uint32_t errors = 0;
+  uint64_t bytesWritten = 0;
+  uint64_t preallocated = 0;
+  uint64_t writeTime = 0;  // us
+  uint32_t maxWriteTime = 0;
+  uint64_t syncTime = 0;  // us
+  uint32_t maxSyncTime = 0;
+
+  // Bytes per second of the time spent writing and syncing
+  uint32_t getThroughput() const {
+    uint64_t time = writeTime + syncTime;
+    return time ? bytesWritten * 1000000 / time : 0;
+  }
+  uint32_t getAverageWriteTime() const {
+    return writes ? writeTime / writes : 0;
+  }
+  uint32_t getAverageSyncTime() const { return syncs ? syncTime / syncs : 0; }
+};
+
+// I/O path of a storage backend, the backends also derive from the file
+// system they mount (sdcard_mmc.hpp, sdcard_sd.hpp, sdcard_posix.hpp) so
+// the same object is passed as the FS. Writes and syncs that go through
+// here are timed and counted, and syncs follow the sync policy.
+class StorageIo {
+ public:
+  virtual ~StorageIo() {}
+
+  // Smallest unit the card writes, writes should start on a multiple of it
+  virtual uint32_t getBlockSize() const { return 512; }
+
+  void setSyncPolicy(SyncPolicy policy, uint32_t interval = 0) {
+    _policy = policy;
+    _interval = interval;
+  }
+  SyncPolicy getSyncPolicy() const { return _policy; }
+
+  size_t write(File& file, const uint8_t* data, size_t len) {
+    if (file.position() % getBlockSize()) _metrics.unaligned++;
+
+    uint32_t start = getMicros();
+    size_t written = writeFile(file, data, len);
+    uint32_t elapsed = getMicros() - start;
+
+    _metrics.writes++;
+    _metrics.bytesWritten += written;
+    _metrics.writeTime += elapsed;
+    if (elapsed > _metrics.maxWriteTime) _metrics.maxWriteTime = elapsed;
+    if (written != len) _metrics.errors++;
+
+    if (_policy == SyncPolicy::EveryWrite) syncNow(file);
+    return written;
+  }
+
+  // Makes the written data and the file size durable if the policy allows
+  // it, force is used when a file is closed
+  bool sync(File& file, bool force = false) {
+    bool due = false;
+
+    switch (_policy) {
+      case SyncPolicy::EveryWrite:
+        return true;  // Already done by write()
+      case SyncPolicy::OnFlush:
+        due = true;
+        break;
+      case SyncPolicy::Interval:
+        due = millis() - _lastSync >= _interval;
+        break;
+      case SyncPolicy::Never:
+        break;
+    }
+
+    if (!due && !force) {
+      _metrics.skippedSyncs++;
+      return true;
+    }
+    return syncNow(file);
+  }
+
+  // Reserves space for length bytes from offset without changing the file
+  // size, false if the backend cannot do that
+  bool preallocate(File& file, uint32_t offset, uint32_t length) {
+    if (!allocateFile(file, offset, length)) return false;
+    _metrics.preallocated += length;
+    return true;
+  }
+
+  const StorageMetrics& getMetrics() const { return _metrics; }
+
+ protected:
+  // Clock of the latency counters
+  virtual uint32_t getMicros() const { return micros(); }
+  virtual size_t writeFile(File& file, const uint8_t* data, size_t len) {
+    return file.write(data, len);
+  }
+  // On the ESP32 flush() also syncs the file descriptor
+  virtual bool syncFile(File& file) {
+    file.flush();
+    return true;
+  }
+  virtual bool allocateFile(File&, uint32_t, uint32_t) { return false; }
+
+ private:
+  SyncPolicy _policy = SyncPolicy::OnFlush;
+  uint32_t _interval = 0;
+  uint32_t _lastSync = 0;
+  StorageMetrics _metrics;
+
+  bool syncNow(File& file) {
+    uint32_t start = getMicros();
+    bool ok = syncFile(file);
+    uint32_t elapsed = getMicros() - start;
+
+    _metrics.syncs++;
+    _metrics.syncTime += elapsed;
+    if (elapsed > _metrics.maxSyncTime) _metrics.maxSyncTime = elapsed;
+    if (!ok) _metrics.errors++;
+    _lastSync = millis();
+    return ok;
+  }
+};
+
+#endif  // GATEWAY
+
+#endif  // SRC_STORAGE_HPP_
+
+// EOF
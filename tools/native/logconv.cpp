@@ -0,0 +1,140 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#if defined(NATIVE)
+
+#include "logconv.hpp"
+
+#include <algorithm>
+#include <map>
+#include <measurement_binary.hpp>
+#include <measurement_series.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Name and token per device, in the order of BinaryTextField
+typedef std::pair<uint8_t, uint32_t> DeviceId;
+typedef std::map<DeviceId, std::string[2]> TextMap;
+// CSV line with its timestamp
+typedef std::pair<uint32_t, std::string> Line;
+
+void applyText(const BinaryTextRecord &record, TextMap *texts) {
+  if (record.field > BinaryToken) return;
+
+  std::string &text = (*texts)[DeviceId(record.type, record.id)][record.field];
+  size_t offset = record.part * BINARY_TEXT_PART;
+
+  if (record.part == 0) text.clear();
+  if (offset >= record.length || text.size() != offset) return;
+
+  size_t n = record.length - offset;
+  text.append(&record.text[0], n < BINARY_TEXT_PART ? n : BINARY_TEXT_PART);
+}
+
+}  // namespace
+
+bool convertLog(const char *fname, FILE *out, ConvertReport *report) {
+  FILE *in = fopen(fname, "rb");
+
+  if (!in) {
+    fprintf(stderr, "Failed to open %s\n", fname);
+    return false;
+  }
+
+  BinaryLogReader reader;
+  TextMap texts;
+  uint8_t slot[BINARY_RECORD_SIZE];
+  char line[MEASUREMENT_CSV_LENGTH];
+  bool header = false;
+  std::vector<Line> lines;  // Series are sorted before they are written
+
+  auto write = [&](const BinaryDataRecord &data) {
+    const std::string *t = texts[DeviceId(data.type, data.id)];
+    size_t len = formatBinaryCsv(data, t[BinaryName].c_str(),
+                                 t[BinaryToken].c_str(), line, sizeof(line));
+    if (reader.getVersion() == BINARY_LOG_VERSION_SERIES)
+      lines.emplace_back(data.created, std::string(line, len));
+    else
+      fwrite(line, 1, len, out);
+    report->records++;
+  };
+
+  while (fread(slot, sizeof(slot), 1, in) == 1) {
+    BinaryLogReader::Result result = reader.add(slot);
+
+    if (result == BinaryLogReader::Header) header = true;
+    if (result != BinaryLogReader::Block) continue;
+
+    for (uint32_t i = 0; i < reader.size(); i += reader.slots(i)) {
+      const uint8_t *record = reader.record(i);
+
+      if (record[0] == BinaryText) {
+        BinaryTextRecord text;
+        memcpy(&text, record, sizeof(text));
+        applyText(text, &texts);
+      } else if (record[0] == BinaryData) {
+        BinaryDataRecord data;
+        memcpy(&data, record, sizeof(data));
+        write(data);
+      } else if (record[0] == BinarySeries) {
+        BinarySeriesRecord series;
+        BinaryDataRecord data;
+        memcpy(&series, record, sizeof(series));
+
+        SeriesDecoder decoder(series, reader.record(i + 1));
+        uint32_t n = 0;
+        while (decoder.next(&data)) {
+          write(data);
+          n++;
+        }
+        if (n != series.count) report->damaged++;
+      }
+    }
+  }
+
+  fclose(in);
+
+  // Samples of a series were held back on the gateway, the lines of the
+  // same second may be in another order than in the CSV log
+  std::stable_sort(
+      lines.begin(), lines.end(),
+      [](const Line &a, const Line &b) { return a.first < b.first; });
+  for (const Line &l : lines) fwrite(l.second.data(), 1, l.second.size(), out);
+
+  report->blocks = reader.getBlocks();
+  report->corrupt = reader.getCorrupt();
+  report->unfinished = reader.getUnfinished();
+
+  if (!header) {
+    fprintf(stderr, "%s is not a binary measurement log\n", fname);
+    return false;
+  }
+  return true;
+}
+
+#endif  // NATIVE
+
+// EOF
@@ -0,0 +1,50 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef TOOLS_NATIVE_LOGCONV_HPP_
+#define TOOLS_NATIVE_LOGCONV_HPP_
+
+#if defined(NATIVE)
+
+#include <cstdint>
+#include <cstdio>
+
+struct ConvertReport {
+  uint64_t records = 0;     // Data records written as CSV
+  uint32_t blocks = 0;
+  uint32_t corrupt = 0;     // Blocks dropped on a count or CRC mismatch
+  uint32_t unfinished = 0;  // Records after the last block end
+  uint32_t damaged = 0;     // Series that could not be fully decoded
+};
+
+// Writes the binary measurement log as v1 CSV, the output is identical to
+// what the gateway writes in CSV mode. A compressed log is sorted by time,
+// lines with the same timestamp can be in another order. Timestamps are
+// formatted in the local time zone like on the gateway, set TZ to match it.
+bool convertLog(const char *fname, FILE *out, ConvertReport *report);
+
+#endif  // NATIVE
+
+#endif  // TOOLS_NATIVE_LOGCONV_HPP_
+
+// EOF
@@ -0,0 +1,517 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#if defined(NATIVE)
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <ble_codec.hpp>
+#include <ble_gateway.hpp>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <data_logger.hpp>
+#include <log.hpp>
+#include <measurement.hpp>
+#include <string>
+#include <vector>
+
+#include "logconv.hpp"
+#include "replay.hpp"
+
+// Host driver for env:native. Replays captured (or generated) advertisements
+// through the real scan callback so the decoders and the measurement list can
+// be load tested and run under perf/valgrind.
+//
+//   program [--realtime] [--speed x] [--loops n] [--batch n] [--verbose]
+//           [--log /file.csv] [--compress] [--query id]
+//           [--storage dir] [--sync every|flush|interval|never] [capture]
+//   program --generate <devices> <seconds> [interval ms] > capture.txt
+//   program --convert <data.bin> > data.csv
+//
+// Without a capture file one advert of every supported format is replayed.
+// With --log the measurements are written through the SD data logger to the
+// file (relative to NATIVE_FS_ROOT or the current directory), in the binary
+// format if the name ends with .bin and as a partitioned log if it is a
+// directory ending with /. --compress writes the binary formats with series
+// records (measurement_series.hpp). --query reads the records of a device (id
+// as listed by --verbose) back from the partitioned log. --convert turns a
+// binary log file back into the v1 CSV.
+//
+// --storage writes the log through the POSIX storage backend rooted in dir
+// instead of the current directory, with the given sync policy (interval
+// syncs once every 60 s of capture time), and prints its I/O counters.
+// Pointing it at a tmpfs or a loop device with a throttled queue compares
+// the logging path on fast and slow media.
+
+MeasurementList myMeasurementList;
+Clock myClock;
+Storage mySdStorage;
+
+namespace {
+
+// Replayed adverts are stamped relative to this epoch (2025-01-01) so the
+// output does not depend on when the harness is run.
+constexpr uint32_t REPLAY_EPOCH = 1735689600;
+
+struct SampleAdvert {
+  const char *address;
+  const char *payload;
+};
+
+const SampleAdvert SAMPLES[] = {
+    {"88:c2:55:ac:26:81",  // Tilt
+     "0201041aff4c000215a495bb40c5b14b44b5121370f02d74de005004d9c5"},
+    {"88:c2:55:ac:26:82",  // Tilt Pro
+     "0201041aff4c000215a495bb20c5b14b44b5121370f02d74de032030f1c5"},
+    {"1a:38:cb:a3:00:01",  // Gravitymon
+     "0201041aff4c000315475241564d4f4e2e00a1b2c32310d111303924a400"},
+    {"1a:38:cb:a3:00:02",  // Pressuremon
+     "0201041aff4c000315505245534d4f4e2e00a1b2c41310d111303924a400"},
+    {"1a:38:cb:a3:00:03",  // Chamber
+     "0201041aff4c0003154348414d4245522e00a1b2c5574a60bd000000000000"},
+    {"1a:38:cb:a3:00:04",  // Gravitymon eddystone
+     "0b09677261766974796d6f6e0201060303aafe1116aafe20000d1124a43039230900a1b"
+     "2c6"},
+    {"5d:d2:61:6a:01:ba",  // RAPT v1
+     "0201041aff524150540100000000a1b2c3a2a0449a5000058f0000000000035b"},
+    {"5d:d2:61:6a:01:bb",  // RAPT v2
+     "0201041aff5241505402000140b5b8d5a2a0449a5000058f0000000000035b"},
+};
+
+// Flags followed by the frame as manufacturer data
+template <typename Frame>
+std::vector<uint8_t> manufacturerAdvert(const Frame &frame) {
+  std::array<uint8_t, Frame::LENGTH> data = encodeFrame(frame);
+  std::vector<uint8_t> payload = {0x02, AD_TYPE_FLAGS, 0x04,
+                                  static_cast<uint8_t>(data.size() + 1),
+                                  AD_TYPE_MANUFACTURER_DATA};
+  payload.insert(payload.end(), data.begin(), data.end());
+  return payload;
+}
+
+// Complete name, flags, service uuid and the frame as eddystone service data
+template <typename Frame>
+std::vector<uint8_t> eddystoneAdvert(const char *name, const Frame &frame) {
+  std::array<uint8_t, Frame::LENGTH> data = encodeFrame(frame);
+  std::vector<uint8_t> payload = {static_cast<uint8_t>(strlen(name) + 1),
+                                  AD_TYPE_COMPLETE_NAME};
+  payload.insert(payload.end(), name, name + strlen(name));
+  const uint8_t service[] = {0x02, AD_TYPE_FLAGS, 0x06, 0x03, 0x03, 0xaa, 0xfe,
+                             static_cast<uint8_t>(data.size() + 3),
+                             AD_TYPE_SERVICE_DATA16, 0xaa, 0xfe};
+  payload.insert(payload.end(), service, service + sizeof(service));
+  payload.insert(payload.end(), data.begin(), data.end());
+  return payload;
+}
+
+std::vector<uint8_t> tiltAdvert(int color, float tempF, float gravity) {
+  std::vector<uint8_t> payload = {0x02, AD_TYPE_FLAGS, 0x04, 0x1a,
+                                  AD_TYPE_MANUFACTURER_DATA,
+                                  0x4c, 0x00, 0x02, 0x15,
+                                  0xa4, 0x95, 0xbb, 0x00, 0xc5, 0xb1, 0x4b,
+                                  0x44, 0xb5, 0x12, 0x13, 0x70, 0xf0, 0x2d,
+                                  0x74, 0xde, 0, 0, 0, 0, 0xc5};
+  uint16_t t = tempF;
+  uint16_t g = gravity * 1000;
+
+  payload[12] = (color + 1) << 4;
+  payload[25] = t >> 8;
+  payload[26] = t & 0xff;
+  payload[27] = g >> 8;
+  payload[28] = g & 0xff;
+  return payload;
+}
+
+// Advert for device number n, every device keeps its format and identity
+// while the readings drift over time.
+std::vector<uint8_t> deviceAdvert(int n, float progress) {
+  float gravity = 1.060 - 0.050 * progress;
+  float tempC = 18.0 + (n % 5) * 0.5;
+  uint32_t chipId = 0xa10000 + n;
+
+  switch (n % 7) {
+    case 0: {
+      GravmonBeaconFrame frame;
+      frame.chipId = chipId;
+      frame.angle = 25 + 40 * gravity - 40;
+      frame.battery = 3.9;
+      frame.gravity = gravity;
+      frame.tempC = tempC;
+      return manufacturerAdvert(frame);
+    }
+    case 1: {
+      GravmonEddystoneFrame frame;
+      frame.chipId = chipId;
+      frame.angle = 30;
+      frame.battery = 4.1;
+      frame.gravity = gravity;
+      frame.tempC = tempC;
+      return eddystoneAdvert("gravitymon", frame);
+    }
+    case 2: {
+      PresmonBeaconFrame frame;
+      frame.chipId = chipId;
+      frame.pressure = 10 + 5 * progress;
+      frame.battery = 3.8;
+      frame.tempC = tempC;
+      return manufacturerAdvert(frame);
+    }
+    case 3: {
+      ChamberBeaconFrame frame;
+      frame.chipId = chipId;
+      frame.chamberTempC = tempC - 1;
+      frame.beerTempC = tempC;
+      return manufacturerAdvert(frame);
+    }
+    case 4: {
+      RaptV1Frame frame;
+      frame.tempC = tempC;
+      frame.gravity = gravity;
+      frame.angleX = 45;
+      frame.battery = 3.7;
+      return manufacturerAdvert(frame);
+    }
+    case 5: {
+      RaptV2Frame frame;
+      frame.velocityValid = true;
+      frame.velocity = -1.5;
+      frame.tempC = tempC;
+      frame.gravity = gravity;
+      frame.angleX = 45;
+      frame.battery = 3.7;
+      return manufacturerAdvert(frame);
+    }
+    default:
+      return tiltAdvert(n % 8, convertCtoF(tempC), gravity);
+  }
+}
+
+constexpr uint32_t PAYLOAD_UPDATE_INTERVAL = 5000;
+
+void generateCapture(int devices, int seconds, int interval) {
+  uint32_t duration = seconds * 1000;
+  uint32_t seed = 1;
+
+  printf("# Generated capture, %d devices, %d s, %d ms interval\n", devices,
+         seconds, interval);
+
+  // Each device starts at a random offset and advertises every interval ms
+  // with +-10% jitter, the adverts are written in timestamp order.
+  std::vector<uint32_t> next(devices);
+  for (int n = 0; n < devices; n++) {
+    seed = seed * 1103515245 + 12345;
+    next[n] = (seed >> 8) % interval;
+  }
+
+  while (true) {
+    int n = std::min_element(next.begin(), next.end()) - next.begin();
+    if (next[n] >= duration) break;
+
+    // Senders only refresh the payload every few seconds and every
+    // advertising event is received on the three advertising channels.
+    uint32_t updated = next[n] - next[n] % PAYLOAD_UPDATE_INTERVAL;
+    CapturedAdvert advert;
+    uint8_t mac[6] = {static_cast<uint8_t>(n), 0x00, 0xa3, 0xcb, 0x38, 0x1a};
+    std::vector<uint8_t> payload =
+        deviceAdvert(n, static_cast<float>(updated) / duration);
+
+    for (int channel = 0; channel < 3; channel++) {
+      seed = seed * 1103515245 + 12345;
+      advert.timestamp = next[n];
+      advert.device.set(NimBLEAddress(mac, 0), -50 - (seed >> 8) % 40,
+                        payload.data(), payload.size());
+      writeCapture(stdout, advert);
+    }
+
+    seed = seed * 1103515245 + 12345;
+    next[n] += interval - interval / 10 + (seed >> 8) % (interval / 5 + 1);
+  }
+}
+
+// Counts the updates pushed by the measurement list while replaying
+class UpdateCounter : public MeasurementObserver {
+ public:
+  uint32_t updates = 0;
+
+  void onMeasurement(int, const MeasurementSnapshot &) override { updates++; }
+};
+
+// Counts the records found by a query, prints them with --verbose
+class QueryPrinter : public DataLogVisitor {
+ public:
+  bool verbose = false;
+  uint32_t records = 0;
+  uint32_t first = 0;
+  uint32_t last = 0;
+
+  bool onRecord(const BinaryDataRecord &record) override {
+    if (!records++) first = record.created;
+    last = record.created;
+
+    if (verbose) {
+      char line[MEASUREMENT_CSV_LENGTH];
+      fwrite(line, 1, formatBinaryCsv(record, "", "", line, sizeof(line)),
+             stdout);
+    }
+    return true;
+  }
+};
+
+bool loadSamples(std::vector<CapturedAdvert> *adverts) {
+  uint32_t timestamp = 0;
+  char line[200];
+
+  for (const SampleAdvert &sample : SAMPLES) {
+    snprintf(line, sizeof(line), "%u %s -60 %s", timestamp, sample.address,
+             sample.payload);
+    adverts->emplace_back();
+    if (!parseCapture(line, &adverts->back())) return false;
+    timestamp += 100;
+  }
+
+  return true;
+}
+
+bool parseSyncPolicy(const char *name, SyncPolicy *policy) {
+  if (!strcmp(name, "every"))
+    *policy = SyncPolicy::EveryWrite;
+  else if (!strcmp(name, "flush"))
+    *policy = SyncPolicy::OnFlush;
+  else if (!strcmp(name, "interval"))
+    *policy = SyncPolicy::Interval;
+  else if (!strcmp(name, "never"))
+    *policy = SyncPolicy::Never;
+  else
+    return false;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ReplayOptions options;
+  const char *capture = nullptr;
+  const char *logFile = nullptr;
+  const char *queryId = nullptr;
+  const char *storage = nullptr;
+  SyncPolicy sync = SyncPolicy::OnFlush;
+  bool compress = false;
+  bool verbose = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--generate") && i + 2 < argc) {
+      generateCapture(atoi(argv[i + 1]), atoi(argv[i + 2]),
+                      i + 3 < argc ? atoi(argv[i + 3]) : 400);
+      return 0;
+    } else if (!strcmp(argv[i], "--convert") && i + 1 < argc) {
+      ConvertReport convert;
+      if (!convertLog(argv[i + 1], stdout, &convert)) return 1;
+      fprintf(stderr,
+              "%" PRIu64 " records in %u blocks, %u corrupt blocks, %u "
+              "records in an unfinished block, %u damaged series\n",
+              convert.records, convert.blocks, convert.corrupt,
+              convert.unfinished, convert.damaged);
+      return convert.corrupt || convert.damaged ? 2 : 0;
+    } else if (!strcmp(argv[i], "--realtime")) {
+      options.realtime = true;
+    } else if (!strcmp(argv[i], "--speed") && i + 1 < argc) {
+      options.speed = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--loops") && i + 1 < argc) {
+      options.loops = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--batch") && i + 1 < argc) {
+      options.batch = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--log") && i + 1 < argc) {
+      logFile = argv[++i];
+    } else if (!strcmp(argv[i], "--compress")) {
+      compress = true;
+    } else if (!strcmp(argv[i], "--query") && i + 1 < argc) {
+      queryId = argv[++i];
+    } else if (!strcmp(argv[i], "--storage") && i + 1 < argc) {
+      storage = argv[++i];
+    } else if (!strcmp(argv[i], "--sync") && i + 1 < argc &&
+               parseSyncPolicy(argv[i + 1], &sync)) {
+      i++;
+    } else if (!strcmp(argv[i], "--verbose")) {
+      verbose = true;
+      options.verbose = true;
+    } else if (argv[i][0] != '-') {
+      capture = argv[i];
+    } else {
+      fprintf(stderr,
+              "usage: %s [--realtime] [--speed x] [--loops n] [--batch n] "
+              "[--verbose] [--log /file.csv] [--compress] [--query id] "
+              "[--storage dir] [--sync every|flush|interval|never] "
+              "[capture]\n"
+              "       %s --generate <devices> <seconds> [interval ms]\n"
+              "       %s --convert <data.bin>\n",
+              argv[0], argv[0], argv[0]);
+      return 1;
+    }
+  }
+
+  if (options.speed <= 0 || options.loops < 1 || options.batch < 1) {
+    fprintf(stderr, "Invalid --speed, --loops or --batch\n");
+    return 1;
+  }
+
+  Log.begin(verbose ? LOG_LEVEL : ESPFWK_LEVEL_WARNING, &Serial, true);
+  myClock.setEpoch(REPLAY_EPOCH);
+  myMeasurementList.begin();
+  bleScanner.setContinuous(true);
+  bleScanner.setAdaptiveScan(true);
+  bleScanner.init();
+
+  UpdateCounter counter;
+  myMeasurementList.subscribe(&counter);
+
+  if (logFile) {
+    std::string path(logFile);
+    FS *fs = &LittleFS;
+    bool started;
+
+    if (storage) {
+      if (!mySdStorage.begin(storage)) return 1;
+      mySdStorage.setSyncPolicy(sync, 60000);
+      myDataLogger.setStorage(&mySdStorage);
+      fs = &mySdStorage;
+    }
+
+    if (path.size() > 1 && path.back() == '/') {
+      path.pop_back();
+      started = myDataLogger.beginPartitioned(
+          fs, path.c_str(),
+          compress ? DataLogFormat::Compressed : DataLogFormat::Binary);
+    } else {
+      bool binary =
+          path.size() > 4 && !path.compare(path.size() - 4, 4, ".bin");
+      started = myDataLogger.begin(
+          fs, logFile,
+          !binary    ? DataLogFormat::Csv
+          : compress ? DataLogFormat::Compressed
+                     : DataLogFormat::Binary);
+    }
+
+    if (!started) return 1;
+    myMeasurementList.subscribe(&myDataLogger);
+  }
+
+  std::vector<CapturedAdvert> adverts;
+
+  if (!(capture ? loadCapture(capture, &adverts) : loadSamples(&adverts)))
+    return 1;
+
+  ReplayReport report;
+  replayCapture(adverts, options, &report);
+
+  if (verbose) {
+    MeasurementSnapshot snapshot;
+    std::vector<HistorySample> history(MEASUREMENT_HISTORY_SIZE);
+
+    for (int i = 0; i < myMeasurementList.getSlots(); i++) {
+      if (!myMeasurementList.getSnapshot(i, &snapshot)) continue;
+
+      int samples = myMeasurementList.getHistory(
+          i, snapshot, 0, UINT32_MAX, history.data(), history.size());
+
+      // The harness runs on the writer side, so the aggregates can be read
+      const AggregateBucket *minute =
+          myMeasurementList.getMeasurementEntry(i)->getAggregates().find(
+              0, snapshot.getData()->getCreated());
+
+      printf("%-20s %-12s %-14s %4d samples over %u s",
+             snapshot.getData()->getTypeAsString(), snapshot.getId(),
+             snapshot.getData()->getSourceAsString(), samples,
+             samples ? history[samples - 1].time - history[0].time : 0);
+      if (minute)
+        printf(", last minute %u samples, value %d..%d mean %d",
+               minute->count, minute->value.min, minute->value.max,
+               minute->getValueMean());
+      printf("\n");
+    }
+    printf("\n");
+  }
+
+  printReport(stdout, &report);
+  printf("Observer received %u updates\n", counter.updates);
+
+  if (logFile) {
+    myDataLogger.end();
+
+    DataLoggerMetrics sd = myDataLogger.getMetrics();
+    uint32_t blocks = sd.writes + sd.flushes;
+    printf("Data log %u records, %u dropped, high water %u, %u writes, "
+           "%u flushes, %" PRIu64 " bytes, flush avg %u us, max %u us\n",
+           sd.records, sd.dropped, sd.queueHighWater, sd.writes, sd.flushes,
+           sd.bytesWritten,
+           blocks ? static_cast<uint32_t>(sd.totalFlushTime / blocks) : 0,
+           sd.maxFlushTime);
+    if (myDataLogger.isPartitioned())
+      printf("Data log %u files, %u errors\n", sd.files, sd.errors);
+
+    if (storage) {
+      const StorageMetrics &io = mySdStorage.getMetrics();
+      printf("Storage %u writes (%u unaligned to %u), %u syncs, %u skipped, "
+             "%" PRIu64 " bytes, %" PRIu64 " preallocated, %u errors\n",
+             io.writes, io.unaligned, mySdStorage.getBlockSize(), io.syncs,
+             io.skippedSyncs, io.bytesWritten, io.preallocated, io.errors);
+      printf("Storage write avg %u us, max %u us, sync avg %u us, max %u us, "
+             "%u KB/s\n",
+             io.getAverageWriteTime(), io.maxWriteTime,
+             io.getAverageSyncTime(), io.maxSyncTime,
+             io.getThroughput() / 1024);
+    }
+  }
+
+  if (queryId && myDataLogger.isPartitioned()) {
+    MeasurementSnapshot snapshot;
+    QueryPrinter printer;
+    printer.verbose = verbose;
+
+    for (int i = 0; i < myMeasurementList.getSlots(); i++) {
+      if (!myMeasurementList.getSnapshot(i, &snapshot) ||
+          strcmp(snapshot.getId(), queryId))
+        continue;
+
+      auto start = std::chrono::steady_clock::now();
+      int found = myDataLogger.query(snapshot.key, 0, UINT32_MAX, &printer);
+      auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start);
+
+      printf("Query %s returned %d records (%u..%u) in %ld us\n", queryId,
+             found, printer.first, printer.last,
+             static_cast<long>(elapsed.count()));
+      break;
+    }
+  }
+  return 0;
+}
+
+#endif  // NATIVE
+
+// EOF
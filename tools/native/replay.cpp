@@ -0,0 +1,293 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#if defined(NATIVE)
+
+#include "replay.hpp"
+
+#include <algorithm>
+#include <ble_gateway.hpp>
+#include <chrono>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+
+// Every heap allocation in the process is counted so the harness can report
+// allocations per advert for the decode path.
+namespace {
+uint64_t allocationCount = 0;
+}  // namespace
+
+void *operator new(size_t size) {
+  allocationCount++;
+  void *p = malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+namespace {
+
+bool parseHex(const char *hex, std::vector<uint8_t> *data) {
+  unsigned int b;
+
+  data->clear();
+  while (hex[0] && hex[1]) {
+    if (sscanf(hex, "%2x", &b) != 1) return false;
+    data->push_back(b);
+    hex += 2;
+  }
+
+  return hex[0] == 0;
+}
+
+bool parseAddress(const char *s, uint8_t *address) {
+  unsigned int a[6];
+
+  if (sscanf(s, "%2x:%2x:%2x:%2x:%2x:%2x", &a[0], &a[1], &a[2], &a[3], &a[4],
+             &a[5]) != 6)
+    return false;
+
+  for (int i = 0; i < 6; i++) address[5 - i] = a[i];  // On air order
+  return true;
+}
+
+// Name of the decoder onResult() will select, using the same registry
+const char *decoderName(const NimBLEAdvertisedDevice &device) {
+  const std::vector<uint8_t> &payload = device.getPayload();
+  AdvertisementView advert(payload.data(), payload.size(),
+                           device.getAddress().getVal(), device.getRSSI());
+
+  const EddystoneType *eddystone = findEddystoneType(advert);
+  if (eddystone) return eddystone->name;
+
+  const BeaconType *beacon = findBeaconType(advert);
+  if (beacon) return beacon->name;
+
+  return "(ignored)";
+}
+
+size_t findDecoder(ReplayReport *report, const char *name) {
+  for (size_t i = 0; i < report->decoders.size(); i++) {
+    if (report->decoders[i].name == name) return i;
+  }
+
+  report->decoders.emplace_back();
+  report->decoders.back().name = name;
+  return report->decoders.size() - 1;
+}
+
+uint32_t percentile(const std::vector<uint32_t> &sorted, int p) {
+  if (sorted.empty()) return 0;
+  size_t i = (sorted.size() - 1) * p / 100;
+  return sorted[i];
+}
+
+}  // namespace
+
+bool parseCapture(const char *line, CapturedAdvert *advert) {
+  unsigned int timestamp;
+  char address[32], hex[700];
+  int rssi;
+  uint8_t mac[6];
+  std::vector<uint8_t> payload;
+
+  if (sscanf(line, "%u %31s %d %699s", &timestamp, address, &rssi, hex) != 4 ||
+      !parseAddress(address, mac) || !parseHex(hex, &payload))
+    return false;
+
+  advert->timestamp = timestamp;
+  advert->device.set(NimBLEAddress(mac, 0), rssi, payload.data(),
+                     payload.size());
+  return true;
+}
+
+bool loadCapture(const char *fname, std::vector<CapturedAdvert> *adverts) {
+  FILE *f = fopen(fname, "r");
+
+  if (!f) {
+    fprintf(stderr, "Unable to open capture %s\n", fname);
+    return false;
+  }
+
+  char line[1024];
+  int lineNo = 0;
+
+  while (fgets(line, sizeof(line), f)) {
+    lineNo++;
+
+    if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') continue;
+
+    adverts->emplace_back();
+
+    if (!parseCapture(line, &adverts->back())) {
+      fprintf(stderr, "%s:%d: invalid advert\n", fname, lineNo);
+      fclose(f);
+      return false;
+    }
+  }
+
+  fclose(f);
+  return true;
+}
+
+void writeCapture(FILE *out, const CapturedAdvert &advert) {
+  const std::vector<uint8_t> &payload = advert.device.getPayload();
+
+  fprintf(out, "%u %s %d ", advert.timestamp,
+          advert.device.getAddress().toString().c_str(),
+          advert.device.getRSSI());
+  for (uint8_t b : payload) fprintf(out, "%02x", b);
+  fprintf(out, "\n");
+}
+
+void replayCapture(const std::vector<CapturedAdvert> &adverts,
+                   const ReplayOptions &options, ReplayReport *report) {
+  typedef std::chrono::steady_clock clock;
+
+  NimBLEScanCallbacks *callbacks = NimBLEDevice::getScan()->getScanCallbacks();
+
+  if (!callbacks || adverts.empty()) return;
+
+  // Resolve decoder names and reserve the sample buffers up front so the
+  // harness itself does not allocate while an advert is measured.
+  std::vector<size_t> stats;
+  stats.reserve(adverts.size());
+
+  for (const CapturedAdvert &advert : adverts)
+    stats.push_back(findDecoder(report, decoderName(advert.device)));
+
+  for (DecoderStats &d : report->decoders)
+    d.latency.reserve(d.latency.size() + adverts.size() * options.loops);
+
+  uint64_t duration = adverts.back().timestamp + 1;
+  int pending = 0;
+  clock::time_point start = clock::now();
+
+  for (int loop = 0; loop < options.loops; loop++) {
+    for (size_t i = 0; i < adverts.size(); i++) {
+      if (options.realtime) {
+        uint64_t at = (loop * duration + adverts[i].timestamp) / options.speed;
+        std::this_thread::sleep_until(start + std::chrono::milliseconds(at));
+      }
+
+      // The gateway sees the recorded time, also when replaying at full speed
+      setNativeMillis(loop * duration + adverts[i].timestamp);
+      NimBLEDevice::getScan()->poll();
+
+      const ScanMetrics &scan = bleScanner.getScanController().getMetrics();
+      if (scan.changes != report->scanChanges) {
+        report->scanChanges = scan.changes;
+        if (options.verbose) {
+          printf("%10u scan %-9s %-15s interval %3u window %3u, %6.1f adv/s, "
+                 "%3.0f%% dup, %u devices, %u missing\n",
+                 static_cast<uint32_t>(millis()),
+                 ScanController::stateToString(scan.state), scan.reason,
+                 scan.interval, scan.window, scan.advertRate,
+                 scan.duplicateRatio * 100, scan.activeDevices,
+                 scan.staleDevices);
+        }
+      }
+
+      uint64_t allocations = allocationCount;
+      clock::time_point t0 = clock::now();
+      callbacks->onResult(&adverts[i].device);
+      if (++pending >= options.batch) {
+        bleScanner.processQueue();  // The consumer task on the device
+        pending = 0;
+      }
+      clock::time_point t1 = clock::now();
+
+      uint64_t ns =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+      allocations = allocationCount - allocations;
+
+      DecoderStats &decoder = report->decoders[stats[i]];
+      decoder.latency.push_back(ns);
+      decoder.allocations += allocations;
+      report->allocations += allocations;
+      report->elapsed += ns;
+      report->adverts++;
+    }
+  }
+
+  bleScanner.processQueue();
+  setNativeMillis(-1);
+  report->wallTime += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          clock::now() - start)
+                          .count();
+}
+
+void printReport(FILE *out, ReplayReport *report) {
+  fprintf(out, "%-14s %9s %9s %9s %9s %9s %9s\n", "Decoder", "Adverts",
+          "p50 us", "p90 us", "p99 us", "max us", "alloc/adv");
+
+  for (DecoderStats &d : report->decoders) {
+    if (d.latency.empty()) continue;
+
+    std::sort(d.latency.begin(), d.latency.end());
+    fprintf(out, "%-14s %9zu %9.2f %9.2f %9.2f %9.2f %9.2f\n", d.name.c_str(),
+            d.latency.size(), percentile(d.latency, 50) / 1000.0,
+            percentile(d.latency, 90) / 1000.0,
+            percentile(d.latency, 99) / 1000.0, d.latency.back() / 1000.0,
+            static_cast<double>(d.allocations) / d.latency.size());
+  }
+
+  double seconds = report->elapsed / 1e9;
+
+  fprintf(out, "\nQueue pushed %u, dropped %u, high water %u\n",
+          bleScanner.getQueuePushed(), bleScanner.getQueueDropped(),
+          bleScanner.getQueueHighWater());
+  fprintf(out, "Scan windows %u, idle %u us (max %u us)\n",
+          bleScanner.getScanWindows(), bleScanner.getScanIdleTime(),
+          bleScanner.getScanMaxIdleTime());
+  const ScanMetrics &scan = bleScanner.getScanController().getMetrics();
+  fprintf(out, "Scan %s, interval %u, window %u, %u changes\n",
+          ScanController::stateToString(scan.state), scan.interval,
+          scan.window, scan.changes);
+  fprintf(out, "Dedup accepted %u, duplicates %u, foreign %u\n",
+          bleScanner.getDedupAccepted(), bleScanner.getDedupDuplicates(),
+          bleScanner.getForeignAdverts());
+  fprintf(out, "Measurements %d of %d, evicted %u, expired %u\n",
+          myMeasurementList.size(), myMeasurementList.getCapacity(),
+          myMeasurementList.getEvicted(), myMeasurementList.getExpired());
+  fprintf(out,
+          "%" PRIu64 " adverts, %.0f adverts/s decoded, wall time "
+          "%.3f s, %.2f allocations/advert\n",
+          report->adverts, seconds > 0 ? report->adverts / seconds : 0.0,
+          report->wallTime / 1e9,
+          report->adverts
+              ? static_cast<double>(report->allocations) / report->adverts
+              : 0.0);
+}
+
+#endif  // NATIVE
+
+// EOF
@@ -0,0 +1,85 @@
+/*
+MIT License
+
+Copyright (c) 2025 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef TOOLS_NATIVE_REPLAY_HPP_
+#define TOOLS_NATIVE_REPLAY_HPP_
+
+#if defined(NATIVE)
+
+#include <NimBLEDevice.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Capture files are plain text, one advertisement per line:
+//
+//   <timestamp ms> <address aa:bb:cc:dd:ee:ff> <rssi> <payload as hex>
+//
+// Empty lines and lines starting with # are ignored. The timestamp is
+// relative to the start of the capture.
+struct CapturedAdvert {
+  uint32_t timestamp = 0;
+  NimBLEAdvertisedDevice device;
+};
+
+bool parseCapture(const char *line, CapturedAdvert *advert);
+bool loadCapture(const char *fname, std::vector<CapturedAdvert> *adverts);
+void writeCapture(FILE *out, const CapturedAdvert &advert);
+
+struct ReplayOptions {
+  bool realtime = false;  // Sleep until the recorded timestamp
+  float speed = 1.0;      // Time scale when replaying in real time
+  int loops = 1;
+  // Adverts queued before the consumer runs, the decode time of the batch is
+  // counted on the advert that triggers it
+  int batch = 1;
+  bool verbose = false;  // Log scan controller decisions
+};
+
+// Latency samples (ns) for one decoder, grouped by the registry name
+struct DecoderStats {
+  std::string name;
+  std::vector<uint32_t> latency;
+  uint64_t allocations = 0;
+};
+
+struct ReplayReport {
+  uint64_t adverts = 0;
+  uint64_t allocations = 0;
+  uint64_t elapsed = 0;  // ns spent in onResult and the consumer
+  uint64_t wallTime = 0;  // ns for the complete replay, including pacing
+  uint32_t scanChanges = 0;
+  std::vector<DecoderStats> decoders;
+};
+
+void replayCapture(const std::vector<CapturedAdvert> &adverts,
+                   const ReplayOptions &options, ReplayReport *report);
+void printReport(FILE *out, ReplayReport *report);
+
+#endif  // NATIVE
+
+#endif  // TOOLS_NATIVE_REPLAY_HPP_
+
+// EOF